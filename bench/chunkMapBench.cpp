@@ -0,0 +1,116 @@
+// Microbenchmark of the chunk index: ChunkMap against the previous
+// std::unordered_map<std::tuple<int, int, int>, std::streampos> with its XOR hash
+#include <iostream>
+#include <unordered_map>
+#include <tuple>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include "chunkMap.hpp"
+
+using ChunkKey = std::tuple<int, int, int>;
+
+// Previous chunk hashing function
+struct KeyHash {
+    std::size_t operator()(const ChunkKey& k) const {
+        auto [x,y,z] = k;
+        return std::hash<long long>()(((long long)x<<40) ^ ((long long)y<<20) ^ (long long)z);
+    }
+};
+
+using OldIndex = std::unordered_map<ChunkKey, std::streampos, KeyHash>;
+
+// Times f and returns nanoseconds per operation
+template <typename F>
+double timeIt(size_t operations, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / operations;
+}
+
+int main(int argc, char** argv) {
+    // World size in chunks (default: 241*21*241, about 1.2M chunks)
+    int radius = argc > 1 ? std::stoi(argv[1]) : 120;
+    int height = 10;
+    // Window used by loadActiveChunks: (2*10 + 1)^3 = 9261 lookups
+    int window = 10;
+    int crossings = 200;
+
+    std::vector<ChunkKey> keys;
+    for (int x = -radius; x <= radius; x++)
+        for (int y = -height; y <= height; y++)
+            for (int z = -radius; z <= radius; z++)
+                keys.push_back({x, y, z});
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+    // Window positions visited while moving, half of the window is outside the world
+    std::vector<ChunkKey> windows;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> dist(-radius, radius);
+    for (int i = 0; i < crossings; i++) {
+        windows.push_back({dist(gen), 0, dist(gen)});
+    }
+
+    std::cout << keys.size() << " chunks, " << crossings << " window loads of "
+        << (2*window + 1)*(2*window + 1)*(2*window + 1) << " chunks\n\n";
+
+    // Sums found values so lookups can't be optimized away
+    long long checkOld = 0, checkNew = 0;
+    size_t lookups = (size_t)crossings*(2*window + 1)*(2*window + 1)*(2*window + 1);
+
+    OldIndex oldIndex;
+    double oldInsert = timeIt(keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            oldIndex[keys[i]] = (std::streamoff)i;
+        }
+    });
+    // Previous loadActiveChunks: find, then operator[]
+    double oldLookup = timeIt(lookups, [&]() {
+        for (auto [cx, cy, cz] : windows)
+            for (int i = -window; i <= window; i++)
+                for (int j = -window; j <= window; j++)
+                    for (int k = -window; k <= window; k++) {
+                        ChunkKey key = {cx + i, cy + j, cz + k};
+                        if (oldIndex.find(key) != oldIndex.end()) {
+                            checkOld += (std::streamoff)oldIndex[key];
+                        }
+                    }
+    });
+
+    ChunkMap<std::streampos> newIndex;
+    double newInsert = timeIt(keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto [x, y, z] = keys[i];
+            newIndex(x, y, z) = (std::streamoff)i;
+        }
+    });
+    double newLookup = timeIt(lookups, [&]() {
+        for (auto [cx, cy, cz] : windows)
+            for (int i = -window; i <= window; i++)
+                for (int j = -window; j <= window; j++)
+                    for (int k = -window; k <= window; k++) {
+                        if (const std::streampos* pos = newIndex.find(cx + i, cy + j, cz + k)) {
+                            checkNew += (std::streamoff)*pos;
+                        }
+                    }
+    });
+
+    // Bucket statistics of the previous hash
+    size_t maxBucket = 0;
+    for (size_t b = 0; b < oldIndex.bucket_count(); b++) {
+        maxBucket = std::max(maxBucket, oldIndex.bucket_size(b));
+    }
+
+    std::cout << "unordered_map  insert " << oldInsert << " ns, window lookup " << oldLookup
+        << " ns, largest bucket " << maxBucket << "\n";
+    std::cout << "ChunkMap       insert " << newInsert << " ns, window lookup " << newLookup << " ns\n";
+
+    if (checkOld != checkNew) {
+        std::cerr << "Error: lookups returned different values\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+#ifndef ASYNC
+#define ASYNC
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+
+// Cancellation flag shared by a CancelSource and the work it started. Work checks it at
+// every suspension point and stops early once it's set
+class CancelToken
+{
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+
+public:
+    // A token that is never cancelled
+    CancelToken() = default;
+    CancelToken(std::shared_ptr<std::atomic<bool>> cancelled);
+    virtual ~CancelToken() = default;
+
+    bool isCancelled() const;
+};
+
+// Owned by whoever may cancel the work
+class CancelSource
+{
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+
+public:
+    CancelSource();
+    virtual ~CancelSource() = default;
+
+    CancelToken getToken() const;
+    void cancel();
+    bool isCancelled() const;
+};
+
+// Coroutine producing a T, started when it's awaited. The awaiting coroutine resumes on the
+// thread that finished the task
+template <typename T>
+class Task
+{
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        // Hands control back to the awaiting coroutine
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_value(T result) {
+            value = std::move(result);
+        }
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    Task(Task&& other) noexcept;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    virtual ~Task();
+
+    bool await_ready() const noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept;
+    T await_resume();
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    Task(std::coroutine_handle<promise_type> handle);
+};
+
+// Coroutine that starts right away and frees itself when it finishes. Nobody awaits it
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+// Coroutines waiting to continue on the main thread, where OpenGL, the chunk store and the
+// caches live. They are resumed by drain(), once per frame
+class MainThreadQueue
+{
+private:
+    std::mutex m_mutex;
+    std::vector<std::coroutine_handle<>> m_waiting;
+
+public:
+    struct Awaiter {
+        MainThreadQueue* queue;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    MainThreadQueue() = default;
+    virtual ~MainThreadQueue() = default;
+
+    // co_await queue.schedule() continues the coroutine on the main thread
+    Awaiter schedule();
+    // Resumes the waiting coroutines until budgetMs milliseconds have passed, the others wait
+    // for the next call. At least one is resumed. Main thread only. Returns how many were resumed
+    size_t drain(double budgetMs);
+    size_t size();
+};
+
+CancelToken::CancelToken(std::shared_ptr<std::atomic<bool>> cancelled) {
+    m_cancelled = std::move(cancelled);
+}
+
+bool CancelToken::isCancelled() const {
+    return m_cancelled && m_cancelled->load(std::memory_order_relaxed);
+}
+
+CancelSource::CancelSource() {
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+}
+
+CancelToken CancelSource::getToken() const {
+    return CancelToken(m_cancelled);
+}
+
+void CancelSource::cancel() {
+    m_cancelled->store(true, std::memory_order_relaxed);
+}
+
+bool CancelSource::isCancelled() const {
+    return m_cancelled->load(std::memory_order_relaxed);
+}
+
+template <typename T>
+Task<T>::Task(std::coroutine_handle<promise_type> handle) {
+    m_handle = handle;
+}
+
+template <typename T>
+Task<T>::Task(Task&& other) noexcept {
+    m_handle = std::exchange(other.m_handle, nullptr);
+}
+
+template <typename T>
+Task<T>::~Task() {
+    if (m_handle) {
+        m_handle.destroy();
+    }
+}
+
+template <typename T>
+bool Task<T>::await_ready() const noexcept {
+    return false;
+}
+
+template <typename T>
+std::coroutine_handle<> Task<T>::await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+}
+
+template <typename T>
+T Task<T>::await_resume() {
+    return std::move(*m_handle.promise().value);
+}
+
+void MainThreadQueue::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(queue->m_mutex);
+    queue->m_waiting.push_back(handle);
+}
+
+MainThreadQueue::Awaiter MainThreadQueue::schedule() {
+    return Awaiter{this};
+}
+
+size_t MainThreadQueue::drain(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::coroutine_handle<>> waiting;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(waiting, m_waiting);
+    }
+
+    // Coroutines queued while these run wait for the next drain
+    size_t resumed = 0;
+    while (resumed < waiting.size()) {
+        waiting[resumed++].resume();
+
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetMs) {
+            break;
+        }
+    }
+
+    // The ones left over go before the ones queued meanwhile
+    if (resumed < waiting.size()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting.insert(m_waiting.begin(), waiting.begin() + resumed, waiting.end());
+    }
+    return resumed;
+}
+
+size_t MainThreadQueue::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_waiting.size();
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef AUTOSAVE
+#define AUTOSAVE
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "loader.hpp"
+
+// Writes chunks to the world file on a background thread. Chunks are handed over as block
+// grid snapshots, which share the blocks with the loaded chunk until it's edited again, so
+// saving doesn't pause the game nor copy the world. The world file and its index are used
+// by the saver thread: other users must hold lockFile() while they read or write them, and
+// check findPending() first since the file doesn't have the snapshots not written yet
+class AutoSaver
+{
+private:
+    std::fstream& m_file;
+
+    std::thread m_thread;
+    // Guards m_pending, m_writing and m_stopping
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    // Guards the world file and wl::chunkIndex
+    std::mutex m_fileMutex;
+
+    // Snapshots waiting to be written. A newer snapshot of a chunk replaces the older one
+    ChunkMap<std::shared_ptr<const BlockGrid>> m_pending;
+    // Snapshots of the batch being written, removed once they are in the file
+    ChunkMap<std::shared_ptr<const BlockGrid>> m_writing;
+    bool m_stopping;
+
+    size_t m_saved;
+
+    // Saver thread: writes the pending snapshots until stop()
+    void run();
+
+public:
+    AutoSaver(std::fstream& file);
+    virtual ~AutoSaver();
+
+    // Starts the saver thread
+    void start();
+    // Writes the remaining snapshots and stops the thread
+    void stop();
+
+    // Queues a chunk's blocks to be saved, and clears its modified flag
+    void save(Chunk& chunk);
+    // Locks the world file against the saver thread
+    std::unique_lock<std::mutex> lockFile();
+    // Snapshot of a chunk that isn't in the file yet, or nullptr. Hold lockFile(): otherwise
+    // the snapshot can be written, and no longer found, before the file is read
+    std::shared_ptr<const BlockGrid> findPending(glm::ivec3 pos);
+
+    // Chunks waiting to be written
+    size_t pendingCount();
+    // Chunks written since start()
+    size_t getSavedCount();
+};
+
+AutoSaver::AutoSaver(std::fstream& file) : m_file(file) {
+    m_stopping = false;
+    m_saved = 0;
+}
+
+AutoSaver::~AutoSaver() {
+    stop();
+}
+
+void AutoSaver::start() {
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_stopping = false;
+    m_thread = std::thread(&AutoSaver::run, this);
+}
+
+void AutoSaver::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void AutoSaver::save(Chunk& chunk) {
+    glm::ivec3 pos = chunk.getChunkPos();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending(pos.x, pos.y, pos.z) = chunk.snapshotBlocks();
+    }
+    chunk.clearModified();
+    m_wake.notify_one();
+}
+
+std::unique_lock<std::mutex> AutoSaver::lockFile() {
+    return std::unique_lock<std::mutex>(m_fileMutex);
+}
+
+std::shared_ptr<const BlockGrid> AutoSaver::findPending(glm::ivec3 pos) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The newest snapshot is the pending one
+    std::shared_ptr<const BlockGrid>* blocks = m_pending.find(pos.x, pos.y, pos.z);
+    if (blocks == nullptr) {
+        blocks = m_writing.find(pos.x, pos.y, pos.z);
+    }
+    return blocks == nullptr ? nullptr : *blocks;
+}
+
+void AutoSaver::run() {
+    while (true) {
+        ChunkMap<std::shared_ptr<const BlockGrid>> batch;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stopping || !m_pending.empty(); });
+            std::swap(batch, m_pending);
+            m_writing = batch;
+            stopping = m_stopping;
+        }
+
+        // The file is locked for one chunk at a time, so loads on the main thread don't
+        // wait for a whole batch. A snapshot leaves m_writing while the file is still locked,
+        // so readers always find it in one or the other
+        batch.forEach([&](int x, int y, int z, std::shared_ptr<const BlockGrid>& blocks) {
+            std::lock_guard<std::mutex> fileLock(m_fileMutex);
+            wl::writeChunk(m_file, x, y, z, *blocks);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_writing.erase(x, y, z);
+        });
+
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> fileLock(m_fileMutex);
+            m_file.flush();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_saved += batch.size();
+        }
+
+        if (stopping) {
+            // Chunks queued while the last batch was written
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pending.empty()) {
+                break;
+            }
+        }
+    }
+}
+
+size_t AutoSaver::pendingCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending.size();
+}
+
+size_t AutoSaver::getSavedCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_saved;
+}
+
+#endif
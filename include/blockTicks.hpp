@@ -0,0 +1,216 @@
+#ifndef BLOCK_TICKS
+#define BLOCK_TICKS
+
+#include <queue>
+#include <vector>
+#include <unordered_set>
+#include <bitset>
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "chunkStore.hpp"
+#include "gamedata.hpp"
+#include "loader.hpp"
+
+// A block update due at a given tick. pos is a world block position
+struct ScheduledTick {
+    glm::ivec3 pos;
+    unsigned long long dueTick;
+    // Keeps ticks due at the same time in scheduling order
+    unsigned long long order;
+};
+
+// Orders the tick queue by earliest due tick
+struct TickCompare {
+    bool operator()(const ScheduledTick& a, const ScheduledTick& b) const {
+        if (a.dueTick != b.dueTick) {
+            return a.dueTick > b.dueTick;
+        }
+        return a.order > b.order;
+    }
+};
+
+// Scheduled block tick engine: only blocks that have been scheduled are visited,
+// so the cost of a tick depends on how many blocks are changing and not on world size
+class BlockTicker
+{
+private:
+    unsigned long long m_currentTick;
+    unsigned long long m_order;
+
+    // Pending ticks, earliest first
+    std::priority_queue<ScheduledTick, std::vector<ScheduledTick>, TickCompare> m_queue;
+    // Blocks already in the queue: one bit per block of each chunk. Keyed by chunk, since
+    // block coordinates would leave ChunkMap's range CHUNCK_SIZE times sooner
+    ChunkMap<std::bitset<CHUNCK_SIZE*CHUNCK_SIZE*CHUNCK_SIZE>> m_scheduled;
+    // Chunks with pending ticks and how many ticks they have pending
+    ChunkMap<unsigned int> m_activeChunks;
+
+    // Runs the update of a single block. Adds changed chunks to modified
+    void updateBlock(const ChunkStore& store, glm::ivec3 pos, std::unordered_set<Chunk*>& modified);
+    // Updates a falling block
+    void updateGravity(const ChunkStore& store, glm::ivec3 pos, std::unordered_set<Chunk*>& modified);
+
+    // Gets / sets a block in world coordinates. Return false if the block is not loaded
+    bool getWorldBlock(const ChunkStore& store, glm::ivec3 pos, blockType& block) const;
+    Chunk* setWorldBlock(const ChunkStore& store, glm::ivec3 pos, blockType block);
+
+    // Index of a block in its chunk's bits of m_scheduled
+    static int localIndex(glm::ivec3 pos, glm::ivec3 chunkPos);
+
+public:
+    BlockTicker();
+    virtual ~BlockTicker() = default;
+
+    // Schedules an update of the block at pos in delay ticks
+    void schedule(glm::ivec3 pos, unsigned int delay);
+    // Schedules the blocks around a block that changed
+    void scheduleNeighbours(glm::ivec3 pos, unsigned int delay);
+
+    // Schedules every gravity block of a newly loaded chunk. Chunks without
+    // gravity blocks are skipped without being scanned
+    void scheduleChunk(const Chunk& chunk);
+
+    // Advances by one tick and runs every update due. Modified chunks are returned once per
+    // tick, so they can be remeshed, saved and reuploaded
+    std::vector<Chunk*> tick(const ChunkStore& store);
+
+    unsigned long long getCurrentTick() const;
+    // Number of chunks with pending updates
+    size_t activeChunkCount() const;
+};
+
+BlockTicker::BlockTicker() {
+    m_currentTick = 0;
+    m_order = 0;
+}
+
+int BlockTicker::localIndex(glm::ivec3 pos, glm::ivec3 chunkPos) {
+    glm::ivec3 local = pos - chunkPos*CHUNCK_SIZE;
+    return (local.x*CHUNCK_SIZE + local.y)*CHUNCK_SIZE + local.z;
+}
+
+void BlockTicker::schedule(glm::ivec3 pos, unsigned int delay) {
+    // A block is only queued once
+    glm::ivec3 chunkPos = wl::blockToChunk(pos);
+    auto& scheduled = m_scheduled(chunkPos.x, chunkPos.y, chunkPos.z);
+    int index = localIndex(pos, chunkPos);
+    if (scheduled.test(index)) {
+        return;
+    }
+    scheduled.set(index);
+
+    m_queue.push({pos, m_currentTick + delay, m_order++});
+    m_activeChunks(chunkPos.x, chunkPos.y, chunkPos.z)++;
+}
+
+void BlockTicker::scheduleNeighbours(glm::ivec3 pos, unsigned int delay) {
+    // For now only the block above can be affected (it may lose its support)
+    schedule(pos + glm::ivec3(0, 1, 0), delay);
+}
+
+void BlockTicker::scheduleChunk(const Chunk& chunk) {
+    if (!chunk.hasGravityBlocks()) {
+        return;
+    }
+
+    glm::ivec3 origin = chunk.getChunkPos()*CHUNCK_SIZE;
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                if (chunk.getBlock(i, j, k).hasGravity) {
+                    schedule(origin + glm::ivec3(i, j, k), GRAVITY_TICK_DELAY);
+                }
+            }
+        }
+    }
+}
+
+std::vector<Chunk*> BlockTicker::tick(const ChunkStore& store) {
+    m_currentTick++;
+
+    // Chunks changed during this tick
+    std::unordered_set<Chunk*> modified;
+
+    while (!m_queue.empty() && m_queue.top().dueTick <= m_currentTick) {
+        ScheduledTick scheduled = m_queue.top();
+        m_queue.pop();
+
+        // Removes the tick from its chunk's pending count and bits
+        glm::ivec3 chunkPos = wl::blockToChunk(scheduled.pos);
+        m_scheduled(chunkPos.x, chunkPos.y, chunkPos.z).reset(localIndex(scheduled.pos, chunkPos));
+        unsigned int* pending = m_activeChunks.find(chunkPos.x, chunkPos.y, chunkPos.z);
+        if (pending != nullptr && --(*pending) == 0) {
+            m_activeChunks.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+            m_scheduled.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+        }
+
+        updateBlock(store, scheduled.pos, modified);
+    }
+
+    return std::vector<Chunk*>(modified.begin(), modified.end());
+}
+
+void BlockTicker::updateBlock(const ChunkStore& store, glm::ivec3 pos, std::unordered_set<Chunk*>& modified) {
+    blockType block;
+
+    // Ticks of unloaded blocks are dropped: the chunk gets scheduled again when it's loaded
+    if (!getWorldBlock(store, pos, block)) {
+        return;
+    }
+
+    if (block.hasGravity) {
+        updateGravity(store, pos, modified);
+    }
+}
+
+void BlockTicker::updateGravity(const ChunkStore& store, glm::ivec3 pos, std::unordered_set<Chunk*>& modified) {
+    glm::ivec3 below = pos - glm::ivec3(0, 1, 0);
+    blockType belowBlock;
+
+    // Waits for the block below to be loaded before falling
+    if (!getWorldBlock(store, below, belowBlock) || !belowBlock.isAir) {
+        return;
+    }
+
+    blockType block;
+    getWorldBlock(store, pos, block);
+
+    // Swaps the falling block with the air below it
+    modified.insert(setWorldBlock(store, below, block));
+    modified.insert(setWorldBlock(store, pos, belowBlock));
+
+    // Keeps falling next tick and wakes up the blocks it was supporting
+    schedule(below, GRAVITY_TICK_DELAY);
+    scheduleNeighbours(pos, GRAVITY_TICK_DELAY);
+}
+
+bool BlockTicker::getWorldBlock(const ChunkStore& store, glm::ivec3 pos, blockType& block) const {
+    glm::ivec3 chunkPos = wl::blockToChunk(pos);
+    Chunk* chunk = store.at(chunkPos);
+    if (chunk == nullptr) {
+        return false;
+    }
+
+    glm::ivec3 local = pos - chunkPos*CHUNCK_SIZE;
+    block = chunk->getBlock(local.x, local.y, local.z);
+    return true;
+}
+
+Chunk* BlockTicker::setWorldBlock(const ChunkStore& store, glm::ivec3 pos, blockType block) {
+    glm::ivec3 chunkPos = wl::blockToChunk(pos);
+    Chunk* chunk = store.at(chunkPos);
+
+    glm::ivec3 local = pos - chunkPos*CHUNCK_SIZE;
+    chunk->setBlock(block, local.x, local.y, local.z);
+    return chunk;
+}
+
+unsigned long long BlockTicker::getCurrentTick() const {
+    return m_currentTick;
+}
+
+size_t BlockTicker::activeChunkCount() const {
+    return m_activeChunks.size();
+}
+
+#endif
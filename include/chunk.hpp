@@ -8,8 +8,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include "gamedata.hpp"
 
+// Occupancy rows are 64 bit masks
+static_assert(CHUNCK_SIZE <= 64, "chunk rows must fit in 64 bits");
+
 // Struct for storing the grid of blocks
 struct BlockGrid {
     blockType blocks[CHUNCK_SIZE][CHUNCK_SIZE][CHUNCK_SIZE];
@@ -29,15 +37,26 @@ class Chunk
 private:
     // Position of the chunk 
     int m_x, m_y, m_z;
-    // Array of block types in the chunk
-    BlockGrid* m_blockGrid;
-    // Vector containing all the vertices and indices of the blocks
+    // Array of block types in the chunk. Copies of the chunk and snapshots share it, it's
+    // copied on the first write while it's shared
+    std::shared_ptr<BlockGrid> m_blockGrid;
+    // Vector containing all the vertices of the blocks. Every 4 vertices make a quad,
+    // indices come from the shared quad index buffer
     std::vector<float> m_vertices;
-    std::vector<unsigned int> m_indices;
-
-    // function to add a block to m_vertices
-    // Position is relative to chunk position
-    void addBlockVertices(glm::ivec3 pos);
+    // True if the chunk contained gravity blocks when last meshed
+    bool m_hasGravityBlocks;
+    // True once the mesh has been built
+    bool m_meshed;
+    // True if blocks were set since the chunk was loaded or last saved
+    bool m_modified;
+    // Occupancy mask: bit k of m_solidRows[x][y] is set if block (x, y, k) is not air.
+    // Kept in sync with the block grid by setBlock
+    uint64_t m_solidRows[CHUNCK_SIZE][CHUNCK_SIZE];
+
+    // Rebuilds the occupancy mask from the block grid
+    void buildOccupancy();
+    // Gives the chunk its own copy of the block grid if it's shared, before a write
+    void detachBlockGrid();
 
     // Utility function for adding a face to
     // m_vertices
@@ -45,7 +64,8 @@ private:
 
 public:
     Chunk();
-    Chunk(glm::ivec3 pos, BlockGrid blocks);
+    // Builds the mesh right away unless mesh is false
+    Chunk(glm::ivec3 pos, BlockGrid blocks, bool mesh = true);
     Chunk(const Chunk& other);
     Chunk& operator=(const Chunk& other);
     virtual ~Chunk();
@@ -54,44 +74,71 @@ public:
     blockType getBlock(int x, int y, int z) const;
     void setBlock(blockType type, int x, int y, int z);
     glm::ivec3 getChunkPos() const;
-
-    // gets blocks verices and texture coordinates
-    std::vector<float> getChunkVertices() const;
-    std::vector<unsigned int> getChunkIndices() const;
-
-    // Returns a translated version of vertices
-    std::vector<float> translateVertices(glm::ivec3 offset) const;
-    std::vector<unsigned int> translateIndices(unsigned int offset) const;
+    const BlockGrid& getBlockGrid() const;
+    // Immutable version of the blocks as they are now, that other threads can read while
+    // the chunk keeps being edited. Doesn't copy the blocks
+    std::shared_ptr<const BlockGrid> snapshotBlocks() const;
+    bool hasGravityBlocks() const;
+
+    // True if blocks were set since the chunk was loaded or since clearModified()
+    bool isModified() const;
+    void clearModified();
+
+    // Occupancy queries, for whole rows of blocks at once
+    bool isSolid(int x, int y, int z) const;
+    // Row of blocks along z at (x, y): bit k is set if block (x, y, k) is not air
+    uint64_t getSolidRow(int x, int y) const;
+    // Solid blocks of a row with at least one face that is not covered by a solid neighbour
+    uint64_t getExposedRow(int x, int y) const;
+    unsigned int getSolidCount() const;
+    // True if every block is air
+    bool isEmpty() const;
+
+    // Rebuilds m_vertices from the block grid
+    void buildMesh();
+    // Uses a mesh built earlier from the same blocks instead of building it
+    void setMesh(const float* vertices, size_t floatCount, bool hasGravityBlocks);
+    bool isMeshed() const;
+    // Hash of the blocks' content, equal for chunks with the same blocks
+    uint64_t hashBlocks() const;
+
+    // Approximate heap and object memory used by the chunk and its mesh, in bytes
+    size_t getMemoryUsage() const;
+
+    // gets blocks verices and texture coordinates, relative to the chunk's corner
+    const std::vector<float>& getChunkVertices() const;
+    unsigned int getQuadCount() const;
 
     // chunk generation
     void fill(blockType type);
 };
 
 Chunk::Chunk() {
+    m_x = 0; m_y = 0; m_z = 0;
+    m_hasGravityBlocks = false;
+    m_meshed = false;
+    m_modified = false;
+    memset(m_solidRows, 0, sizeof(m_solidRows));
+
     // Creates the chunk's memory on the heap
-    m_blockGrid = new BlockGrid;
+    m_blockGrid = std::make_shared<BlockGrid>();
 }
 
-Chunk::Chunk(glm::ivec3 pos, BlockGrid blocks) {
+Chunk::Chunk(glm::ivec3 pos, BlockGrid blocks, bool mesh) {
     // assings positions
     m_x = pos.x; m_y = pos.y; m_z = pos.z;
 
     // Creates the chunk's memory on the heap
-    m_blockGrid = new BlockGrid;
-    *m_blockGrid = blocks;
+    m_blockGrid = std::make_shared<BlockGrid>(blocks);
+    m_hasGravityBlocks = false;
+    m_meshed = false;
+    m_modified = false;
+    buildOccupancy();
 
     // Adds blocks' vertices
-    for (int i = 0; i < CHUNCK_SIZE; i++) {
-        for (int j = 0; j < CHUNCK_SIZE; j++) {
-            for (int k = 0; k < CHUNCK_SIZE; k++) {
-                if (!m_blockGrid->blocks[i][j][k].isAir)
-                {
-                    addBlockVertices(glm::ivec3(i, j, k));                
-                }
-            }
-        }
+    if (mesh) {
+        buildMesh();
     }
-    
 }
 
 Chunk::Chunk(const Chunk& other) {
@@ -99,11 +146,14 @@ Chunk::Chunk(const Chunk& other) {
     m_y = other.m_y;
     m_z = other.m_z;
 
-    m_blockGrid = new BlockGrid;
-    *m_blockGrid = *other.m_blockGrid;
+    // Shares the blocks until one of the chunks is edited
+    m_blockGrid = other.m_blockGrid;
 
     m_vertices = other.getChunkVertices();
-    m_indices = other.getChunkIndices();
+    m_hasGravityBlocks = other.m_hasGravityBlocks;
+    m_meshed = other.m_meshed;
+    m_modified = other.m_modified;
+    memcpy(m_solidRows, other.m_solidRows, sizeof(m_solidRows));
 }
 
 Chunk& Chunk::operator=(const Chunk& other) {
@@ -112,21 +162,20 @@ Chunk& Chunk::operator=(const Chunk& other) {
         m_y = other.m_y;
         m_z = other.m_z;
 
-        // Frees old memory
-        delete m_blockGrid;
-
-        // reallocates and copies new memory
-        m_blockGrid = new BlockGrid;
-        *m_blockGrid = *other.m_blockGrid;
+        // Shares the blocks until one of the chunks is edited. The old grid is freed
+        // once nothing else holds it
+        m_blockGrid = other.m_blockGrid;
 
         m_vertices = other.getChunkVertices();
-        m_indices = other.getChunkIndices();
+        m_hasGravityBlocks = other.m_hasGravityBlocks;
+        m_meshed = other.m_meshed;
+        m_modified = other.m_modified;
+        memcpy(m_solidRows, other.m_solidRows, sizeof(m_solidRows));
     }
     return *this;
 }
 
 Chunk::~Chunk() {
-    delete m_blockGrid;
 }
 
 // Returns a block at a given position
@@ -144,7 +193,15 @@ void Chunk::setBlock(blockType type, int x, int y, int z) {
         std::cerr << "Error: setBlock index cannot be larger than chunk size\n";
     }
 
+    detachBlockGrid();
     m_blockGrid->blocks[x][y][z] = type;
+    m_modified = true;
+
+    if (type.isAir) {
+        m_solidRows[x][y] &= ~(1ULL << z);
+    } else {
+        m_solidRows[x][y] |= 1ULL << z;
+    }
 }
 
 // Fills the chunk with one blocktype
@@ -166,18 +223,167 @@ glm::ivec3 Chunk::getChunkPos() const{
     return glm::ivec3(m_x, m_y, m_z);
 }
 
-void Chunk::addBlockVertices(glm::ivec3 pos) {
-    // Adds all faces
-    for (int i = 0; i < 6; i++)
-    {
-        // Adds the face
-        addFace(pos, static_cast<FaceDir>(i));
+// Returns the chunk's block data
+const BlockGrid& Chunk::getBlockGrid() const {
+    return *m_blockGrid;
+}
+
+std::shared_ptr<const BlockGrid> Chunk::snapshotBlocks() const {
+    return m_blockGrid;
+}
+
+void Chunk::detachBlockGrid() {
+    // Only the chunk's owner adds references, so once the count is 1 nobody else can read
+    // the grid. A reader on another thread can drop its reference meanwhile: then the
+    // grid is copied for nothing, which is safe
+    if (m_blockGrid.use_count() > 1) {
+        m_blockGrid = std::make_shared<BlockGrid>(*m_blockGrid);
+    } else {
+        // Pairs with the release of the reader's reference, so its reads happen before our writes
+        std::atomic_thread_fence(std::memory_order_acquire);
     }
 }
 
+bool Chunk::isModified() const {
+    return m_modified;
+}
+
+void Chunk::clearModified() {
+    m_modified = false;
+}
+
+bool Chunk::hasGravityBlocks() const {
+    return m_hasGravityBlocks;
+}
+
+void Chunk::buildOccupancy() {
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            uint64_t row = 0;
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                if (!m_blockGrid->blocks[i][j][k].isAir) {
+                    row |= 1ULL << k;
+                }
+            }
+            m_solidRows[i][j] = row;
+        }
+    }
+}
+
+bool Chunk::isSolid(int x, int y, int z) const {
+    return (m_solidRows[x][y] >> z) & 1;
+}
+
+uint64_t Chunk::getSolidRow(int x, int y) const {
+    return m_solidRows[x][y];
+}
+
+uint64_t Chunk::getExposedRow(int x, int y) const {
+    uint64_t row = m_solidRows[x][y];
+
+    // Blocks covered on every side. Neighbours outside the chunk count as air
+    uint64_t covered = (row << 1) & (row >> 1);
+    covered &= x > 0 ? m_solidRows[x - 1][y] : 0;
+    covered &= x < CHUNCK_SIZE - 1 ? m_solidRows[x + 1][y] : 0;
+    covered &= y > 0 ? m_solidRows[x][y - 1] : 0;
+    covered &= y < CHUNCK_SIZE - 1 ? m_solidRows[x][y + 1] : 0;
+
+    return row & ~covered;
+}
+
+unsigned int Chunk::getSolidCount() const {
+    unsigned int count = 0;
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            count += __builtin_popcountll(m_solidRows[i][j]);
+        }
+    }
+    return count;
+}
+
+bool Chunk::isEmpty() const {
+    uint64_t any = 0;
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            any |= m_solidRows[i][j];
+        }
+    }
+    return any == 0;
+}
+
+bool Chunk::isMeshed() const {
+    return m_meshed;
+}
+
+size_t Chunk::getMemoryUsage() const {
+    return sizeof(Chunk) + sizeof(BlockGrid) + m_vertices.capacity()*sizeof(float);
+}
+
+void Chunk::buildMesh() {
+    m_vertices.clear();
+    m_hasGravityBlocks = false;
+    m_meshed = true;
+
+    // Works on whole rows along z: a face is visible where the block is solid and its
+    // neighbour in that direction is not. Faces on the chunk's border are always visible
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            uint64_t row = m_solidRows[i][j];
+            if (row == 0) {
+                continue;
+            }
+
+            uint64_t visible[6];
+            visible[FRONT] = row & ~(row << 1);
+            visible[BACK] = row & ~(row >> 1);
+            visible[LEFT] = row & ~(i > 0 ? m_solidRows[i - 1][j] : 0);
+            visible[RIGHT] = row & ~(i < CHUNCK_SIZE - 1 ? m_solidRows[i + 1][j] : 0);
+            visible[BOTTOM] = row & ~(j > 0 ? m_solidRows[i][j - 1] : 0);
+            visible[TOP] = row & ~(j < CHUNCK_SIZE - 1 ? m_solidRows[i][j + 1] : 0);
+
+            for (int face = 0; face < 6; face++) {
+                for (uint64_t bits = visible[face]; bits != 0; bits &= bits - 1) {
+                    addFace(glm::ivec3(i, j, __builtin_ctzll(bits)), static_cast<FaceDir>(face));
+                }
+            }
+
+            // Only solid blocks can have gravity
+            for (uint64_t bits = row; bits != 0 && !m_hasGravityBlocks; bits &= bits - 1) {
+                m_hasGravityBlocks = m_blockGrid->blocks[i][j][__builtin_ctzll(bits)].hasGravity;
+            }
+        }
+    }
+}
+
+void Chunk::setMesh(const float* vertices, size_t floatCount, bool hasGravityBlocks) {
+    m_vertices.assign(vertices, vertices + floatCount);
+    m_hasGravityBlocks = hasGravityBlocks;
+    m_meshed = true;
+}
+
+uint64_t Chunk::hashBlocks() const {
+    // FNV-1a over the fields of every block, blockType has padding bytes
+    uint64_t hash = 14695981039346656037ULL;
+    auto addByte = [&hash](unsigned char byte) {
+        hash ^= byte;
+        hash *= 1099511628211ULL;
+    };
+
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                const blockType& block = m_blockGrid->blocks[i][j][k];
+                for (int b = 0; b < 4; b++) {
+                    addByte((block.ID >> (8*b)) & 0xff);
+                }
+                addByte(block.isAir | block.hasGravity << 1);
+            }
+        }
+    }
+    return hash;
+}
+
 void Chunk::addFace(glm::ivec3 pos, FaceDir direction) {
-    // How many vertices have already been made
-    int startIndex = m_vertices.size() / 3;
     int x, y, z;
     x = pos.x, y = pos.y, z = pos.z;
 
@@ -228,51 +434,27 @@ void Chunk::addFace(glm::ivec3 pos, FaceDir direction) {
             break;
     }
 
+    // Texture coordinates of the face's corners
+    const float uv[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    // The texture array layer is the block's ID
+    float layer = m_blockGrid->blocks[x][y][z].ID;
+
     // Adds vertices to m_vertices
     for (int i = 0; i < 4; i++) {
         m_vertices.push_back(v[i][0]);
         m_vertices.push_back(v[i][1]);
         m_vertices.push_back(v[i][2]);
+        m_vertices.push_back(uv[i][0]);
+        m_vertices.push_back(uv[i][1]);
+        m_vertices.push_back(layer);
     }
-
-    // Adds indices
-    m_indices.push_back(startIndex + 0);
-    m_indices.push_back(startIndex + 1);
-    m_indices.push_back(startIndex + 2);
-
-    m_indices.push_back(startIndex + 0);
-    m_indices.push_back(startIndex + 2);
-    m_indices.push_back(startIndex + 3);
 }
 
-std::vector<float> Chunk::getChunkVertices() const {
+const std::vector<float>& Chunk::getChunkVertices() const {
     return m_vertices;
 }
 
-std::vector<unsigned int> Chunk::getChunkIndices() const {
-    return m_indices;
-}
-
-std::vector<float> Chunk::translateVertices(glm::ivec3 offset) const {
-    std::vector<float> translatedVertices;
-
-    for (int i = 0; i < m_vertices.size(); i += 3)
-    {
-        translatedVertices.push_back(m_vertices[i] + offset.x);
-        translatedVertices.push_back(m_vertices[i + 1] + offset.y);
-        translatedVertices.push_back(m_vertices[i + 2] + offset.z);
-    }
-
-    return translatedVertices;
-}
-
-std::vector<unsigned int> Chunk::translateIndices(unsigned int offset) const {
-    std::vector<unsigned int> indices;
-    for (int i = 0; i < m_indices.size(); i++)
-    {
-        indices.push_back(m_indices[i] + offset);
-    }
-    return indices;
+unsigned int Chunk::getQuadCount() const {
+    return m_vertices.size() / (4*VERTEX_SIZE);
 }
 #endif
-
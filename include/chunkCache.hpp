@@ -0,0 +1,107 @@
+#ifndef CHUNK_CACHE
+#define CHUNK_CACHE
+
+#include <list>
+#include <memory>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+
+// Keeps chunks that left the window, with their meshes, so that they can come back
+// without being read and meshed again. When the memory budget is exceeded the least
+// recently used chunks are dropped
+class ChunkCache
+{
+private:
+    // Most recently stored first
+    std::list<std::unique_ptr<Chunk>> m_chunks;
+    ChunkMap<std::list<std::unique_ptr<Chunk>>::iterator> m_index;
+
+    size_t m_budget;
+    size_t m_memoryUsage;
+
+    // Drops the least recently used chunks until the cache fits in the budget
+    void trim();
+
+public:
+    // budget is in bytes
+    ChunkCache(size_t budget);
+    virtual ~ChunkCache() = default;
+
+    // Stores a chunk, replacing any cached copy of the same position
+    void store(std::unique_ptr<Chunk> chunk);
+    // Takes a chunk out of the cache. Returns nullptr if it's not cached
+    std::unique_ptr<Chunk> take(glm::ivec3 chunkPos);
+    bool contains(glm::ivec3 chunkPos) const;
+
+    void clear();
+    size_t size() const;
+    size_t getMemoryUsage() const;
+    size_t getBudget() const;
+};
+
+ChunkCache::ChunkCache(size_t budget) {
+    m_budget = budget;
+    m_memoryUsage = 0;
+}
+
+void ChunkCache::store(std::unique_ptr<Chunk> chunk) {
+    glm::ivec3 pos = chunk->getChunkPos();
+    take(pos);
+
+    m_memoryUsage += chunk->getMemoryUsage();
+    m_chunks.push_front(std::move(chunk));
+    m_index(pos.x, pos.y, pos.z) = m_chunks.begin();
+
+    trim();
+}
+
+std::unique_ptr<Chunk> ChunkCache::take(glm::ivec3 chunkPos) {
+    auto* found = m_index.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (found == nullptr) {
+        return nullptr;
+    }
+
+    std::list<std::unique_ptr<Chunk>>::iterator it = *found;
+    m_index.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+
+    std::unique_ptr<Chunk> chunk = std::move(*it);
+    m_chunks.erase(it);
+    m_memoryUsage -= chunk->getMemoryUsage();
+    return chunk;
+}
+
+bool ChunkCache::contains(glm::ivec3 chunkPos) const {
+    return m_index.find(chunkPos.x, chunkPos.y, chunkPos.z) != nullptr;
+}
+
+void ChunkCache::trim() {
+    while (m_memoryUsage > m_budget && !m_chunks.empty()) {
+        std::unique_ptr<Chunk>& oldest = m_chunks.back();
+        glm::ivec3 pos = oldest->getChunkPos();
+
+        m_memoryUsage -= oldest->getMemoryUsage();
+        m_index.erase(pos.x, pos.y, pos.z);
+        m_chunks.pop_back();
+    }
+}
+
+void ChunkCache::clear() {
+    m_chunks.clear();
+    m_index.clear();
+    m_memoryUsage = 0;
+}
+
+size_t ChunkCache::size() const {
+    return m_chunks.size();
+}
+
+size_t ChunkCache::getMemoryUsage() const {
+    return m_memoryUsage;
+}
+
+size_t ChunkCache::getBudget() const {
+    return m_budget;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef CHUNK_CLIENT
+#define CHUNK_CLIENT
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <string>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "chunkProtocol.hpp"
+
+// Chunk received from the server
+struct ReceivedChunk {
+    glm::ivec3 pos;
+    BlockGrid data;
+};
+
+// Gets chunks from a chunk server instead of the world file. Requests are pipelined:
+// they are all sent right away and answers are collected once per frame with poll()
+class ChunkClient
+{
+private:
+    std::unique_ptr<net::Connection> m_connection;
+    uint32_t m_nextRequestId;
+    // Chunks requested and not received yet
+    ChunkMap<uint32_t> m_inFlight;
+
+public:
+    ChunkClient();
+    virtual ~ChunkClient() = default;
+
+    // Connects to the server listening at socketPath. Returns false on failure
+    bool connect(const std::string& socketPath);
+    bool isConnected() const;
+
+    // Requests a chunk, unless it has already been requested
+    void request(glm::ivec3 chunkPos);
+    bool isRequested(glm::ivec3 chunkPos) const;
+    size_t inFlightCount() const;
+
+    // Sends a modified chunk to the server, which saves it
+    void put(const Chunk& chunk);
+
+    // Sends queued requests and returns the chunks received since the last call
+    std::vector<ReceivedChunk> poll();
+};
+
+ChunkClient::ChunkClient() {
+    m_nextRequestId = 0;
+}
+
+bool ChunkClient::connect(const std::string& socketPath) {
+    int fd = net::connectSocket(socketPath);
+    if (fd < 0) {
+        return false;
+    }
+
+    m_connection = std::make_unique<net::Connection>(fd);
+    return true;
+}
+
+bool ChunkClient::isConnected() const {
+    return m_connection != nullptr;
+}
+
+void ChunkClient::request(glm::ivec3 chunkPos) {
+    auto [requestId, inserted] = m_inFlight.tryEmplace(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (!inserted || !isConnected()) {
+        return;
+    }
+
+    *requestId = m_nextRequestId++;
+    m_connection->send({net::MSG_GET_CHUNK, *requestId, chunkPos.x, chunkPos.y, chunkPos.z, 0});
+}
+
+bool ChunkClient::isRequested(glm::ivec3 chunkPos) const {
+    return m_inFlight.find(chunkPos.x, chunkPos.y, chunkPos.z) != nullptr;
+}
+
+size_t ChunkClient::inFlightCount() const {
+    return m_inFlight.size();
+}
+
+void ChunkClient::put(const Chunk& chunk) {
+    if (!isConnected()) {
+        return;
+    }
+
+    glm::ivec3 pos = chunk.getChunkPos();
+    m_connection->send({net::MSG_PUT_CHUNK, m_nextRequestId++, pos.x, pos.y, pos.z, 0}, net::encodeBlocks(chunk.getBlockGrid()));
+}
+
+std::vector<ReceivedChunk> ChunkClient::poll() {
+    std::vector<ReceivedChunk> received;
+    if (!isConnected()) {
+        return received;
+    }
+
+    if (!m_connection->flush() || !m_connection->receive()) {
+        std::cerr << "Lost connection to the chunk server\n";
+        m_connection.reset();
+        return received;
+    }
+
+    net::MessageHeader header;
+    std::vector<uint8_t> payload;
+    bool broken = false;
+    while (m_connection->next(header, payload, broken)) {
+        glm::ivec3 pos(header.x, header.y, header.z);
+        if (!ChunkMap<uint32_t>::inRange(pos.x, pos.y, pos.z)) {
+            continue;
+        }
+        const uint32_t* requestId = m_inFlight.find(pos.x, pos.y, pos.z);
+
+        // Ignores answers to requests it didn't send
+        if (header.type != net::MSG_CHUNK || requestId == nullptr || *requestId != header.requestId) {
+            continue;
+        }
+
+        // Asks again for a chunk that can't be decoded, so that it doesn't stay requested forever
+        ReceivedChunk chunk;
+        chunk.pos = pos;
+        if (!net::decodeBlocks(payload.data(), payload.size(), chunk.data)) {
+            std::cerr << "Error: invalid chunk received from the server, requesting it again\n";
+            uint32_t retryId = m_nextRequestId++;
+            *m_inFlight.find(pos.x, pos.y, pos.z) = retryId;
+            m_connection->send({net::MSG_GET_CHUNK, retryId, pos.x, pos.y, pos.z, 0});
+            continue;
+        }
+        m_inFlight.erase(pos.x, pos.y, pos.z);
+        received.push_back(chunk);
+    }
+
+    if (broken) {
+        std::cerr << "Error: invalid message received from the server\n";
+        m_connection.reset();
+    }
+    return received;
+}
+
+#endif
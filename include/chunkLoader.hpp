@@ -0,0 +1,217 @@
+#ifndef CHUNK_LOADER
+#define CHUNK_LOADER
+
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "worldGenerator.hpp"
+#include "loader.hpp"
+#include "autosave.hpp"
+#include "meshCache.hpp"
+#include "async.hpp"
+#include "workerPool.hpp"
+
+// Loads chunks from the world file asynchronously. A request is a coroutine that reads or
+// generates the blocks on a worker, checks the mesh cache on the main thread, meshes on a
+// worker if needed and finishes on the main thread. Each request has a cancellation token
+// checked between these steps: work for chunks nobody wants anymore stops at the next step
+class ChunkLoader
+{
+private:
+    struct InFlightLoad {
+        CancelSource source;
+        // Tells a request apart from an older, cancelled one for the same chunk
+        uint64_t id;
+    };
+
+    std::fstream& m_file;
+    // Its file lock guards the world file and the chunk index
+    AutoSaver& m_saver;
+    MeshCache& m_meshCache;
+    WorkerPool& m_pool;
+    MainThreadQueue& m_mainThread;
+    // One generator per worker. Copies share the stage caches
+    std::vector<WorldGenerator> m_generators;
+
+    ChunkMap<InFlightLoad> m_inFlight;
+    uint64_t m_nextId;
+    // Requests still running, including cancelled ones that haven't stopped yet
+    size_t m_running;
+
+    size_t m_completed;
+    size_t m_cancelled;
+
+    // Reads the blocks, or generates them and adds them to the file. Runs on a worker
+    BlockGrid readBlocks(glm::ivec3 pos);
+
+    // Runs a request and passes the chunk to onLoaded on the main thread
+    template <typename F>
+    DetachedTask run(glm::ivec3 pos, float priority, CancelToken token, uint64_t id, F onLoaded);
+
+public:
+    // The pool must be started: each of its workers gets a generator
+    ChunkLoader(const WorldGenerator& generator, std::fstream& file, AutoSaver& saver, MeshCache& meshCache,
+        WorkerPool& pool, MainThreadQueue& mainThread);
+    virtual ~ChunkLoader() = default;
+
+    // co_await loader.requestChunk(pos, priority, token) gives the loaded and meshed chunk,
+    // or nullptr if the request was cancelled. The awaiting coroutine resumes on the main thread
+    Task<std::unique_ptr<Chunk>> requestChunk(glm::ivec3 pos, float priority, CancelToken token);
+
+    // Starts loading a chunk unless it's already being loaded. onLoaded(std::unique_ptr<Chunk>)
+    // is called on the main thread once it's ready. Returns false if it was already in flight
+    template <typename F>
+    bool request(glm::ivec3 pos, float priority, F onLoaded);
+    bool isInFlight(glm::ivec3 pos) const;
+
+    // Cancels the loads for which cancel(pos) is true. Main thread only
+    template <typename F>
+    void cancelIf(F cancel);
+    void cancelAll();
+
+    // Loads not finished yet, including cancelled ones that haven't stopped yet
+    size_t inFlightCount() const;
+    size_t getCompleted() const;
+    size_t getCancelled() const;
+};
+
+ChunkLoader::ChunkLoader(const WorldGenerator& generator, std::fstream& file, AutoSaver& saver, MeshCache& meshCache,
+    WorkerPool& pool, MainThreadQueue& mainThread)
+    : m_file(file), m_saver(saver), m_meshCache(meshCache), m_pool(pool), m_mainThread(mainThread) {
+    m_generators.assign(std::max(1, pool.getThreadCount()), generator);
+    m_nextId = 0;
+    m_running = 0;
+    m_completed = 0;
+    m_cancelled = 0;
+}
+
+BlockGrid ChunkLoader::readBlocks(glm::ivec3 pos) {
+    BlockGrid data;
+    {
+        // Edits of a chunk evicted from the cache can still be waiting for the saver thread
+        std::unique_lock<std::mutex> fileLock = m_saver.lockFile();
+        std::shared_ptr<const BlockGrid> pending = m_saver.findPending(pos);
+        if (pending) {
+            return *pending;
+        }
+        if (wl::readChunkData(m_file, pos.x, pos.y, pos.z, data)) {
+            return data;
+        }
+    }
+
+    // Generation doesn't need the file, workers generate in parallel
+    data = m_generators[std::max(0, WorkerPool::currentWorker())].genChunk(pos.x, pos.y, pos.z);
+
+    std::unique_lock<std::mutex> fileLock = m_saver.lockFile();
+    if (wl::chunkIndex.find(pos.x, pos.y, pos.z) == nullptr) {
+        wl::writeChunk(m_file, pos.x, pos.y, pos.z, data);
+    }
+    return data;
+}
+
+Task<std::unique_ptr<Chunk>> ChunkLoader::requestChunk(glm::ivec3 pos, float priority, CancelToken token) {
+    std::unique_ptr<Chunk> chunk;
+
+    co_await m_pool.schedule(pos, priority, token);
+    if (!token.isCancelled()) {
+        chunk = std::make_unique<Chunk>(pos, readBlocks(pos), false);
+    }
+
+    co_await m_mainThread.schedule();
+    if (!chunk || token.isCancelled()) {
+        co_return nullptr;
+    }
+
+    // Empty chunks have nothing to mesh, and cached meshes are ready as they are
+    if (chunk->isEmpty()) {
+        chunk->buildMesh();
+        co_return std::move(chunk);
+    }
+    if (m_meshCache.isOpen() && m_meshCache.load(*chunk)) {
+        co_return std::move(chunk);
+    }
+
+    co_await m_pool.schedule(pos, priority, token);
+    if (!token.isCancelled()) {
+        chunk->buildMesh();
+    }
+
+    co_await m_mainThread.schedule();
+    if (token.isCancelled()) {
+        co_return nullptr;
+    }
+    m_meshCache.store(*chunk);
+    co_return std::move(chunk);
+}
+
+template <typename F>
+DetachedTask ChunkLoader::run(glm::ivec3 pos, float priority, CancelToken token, uint64_t id, F onLoaded) {
+    m_running++;
+    std::unique_ptr<Chunk> chunk = co_await requestChunk(pos, priority, token);
+    m_running--;
+
+    // Back on the main thread. A newer request for the chunk may have replaced this one
+    InFlightLoad* load = m_inFlight.find(pos.x, pos.y, pos.z);
+    if (load != nullptr && load->id == id) {
+        m_inFlight.erase(pos.x, pos.y, pos.z);
+    }
+
+    if (chunk) {
+        m_completed++;
+        onLoaded(std::move(chunk));
+    } else {
+        m_cancelled++;
+    }
+}
+
+template <typename F>
+bool ChunkLoader::request(glm::ivec3 pos, float priority, F onLoaded) {
+    InFlightLoad* load = m_inFlight.find(pos.x, pos.y, pos.z);
+    if (load != nullptr && !load->source.isCancelled()) {
+        return false;
+    }
+
+    CancelSource source;
+    uint64_t id = m_nextId++;
+    m_inFlight(pos.x, pos.y, pos.z) = {source, id};
+    run(pos, priority, source.getToken(), id, onLoaded);
+    return true;
+}
+
+bool ChunkLoader::isInFlight(glm::ivec3 pos) const {
+    const InFlightLoad* load = m_inFlight.find(pos.x, pos.y, pos.z);
+    return load != nullptr && !load->source.isCancelled();
+}
+
+template <typename F>
+void ChunkLoader::cancelIf(F cancel) {
+    m_inFlight.forEach([&](int x, int y, int z, InFlightLoad& load) {
+        if (!load.source.isCancelled() && cancel(glm::ivec3(x, y, z))) {
+            load.source.cancel();
+        }
+    });
+}
+
+void ChunkLoader::cancelAll() {
+    cancelIf([](glm::ivec3) {
+        return true;
+    });
+}
+
+size_t ChunkLoader::inFlightCount() const {
+    return m_running;
+}
+
+size_t ChunkLoader::getCompleted() const {
+    return m_completed;
+}
+
+size_t ChunkLoader::getCancelled() const {
+    return m_cancelled;
+}
+
+#endif
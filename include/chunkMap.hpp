@@ -0,0 +1,287 @@
+#ifndef CHUNK_MAP
+#define CHUNK_MAP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <cassert>
+
+// Chunk coordinates must be in [-CHUNK_COORD_LIMIT, CHUNK_COORD_LIMIT), others alias other chunks
+#define CHUNK_COORD_LIMIT (1 << 20)
+
+// Hash table keyed by chunk coordinates. Coordinates are packed into a single 64 bit Morton
+// code (21 bits per axis, see CHUNK_COORD_LIMIT), hashed with a 64 bit mixer and stored
+// with open addressing and linear probing in one flat array.
+// Values are stored inline, so V should be small (a file offset, a pointer, a counter...).
+// V has to be default constructible and movable
+template <typename V>
+class ChunkMap
+{
+private:
+    // No valid key uses the top bit, so all ones marks an empty slot
+    static constexpr uint64_t EMPTY = ~0ULL;
+
+    struct Slot {
+        uint64_t key = EMPTY;
+        V value = V();
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_size;
+    size_t m_mask;
+
+    // Spreads every key bit over the whole hash (murmur3 finalizer)
+    static uint64_t mix(uint64_t k);
+    // Spreads the lower 21 bits of v so that there are 2 zero bits between each of them
+    static uint64_t spreadBits(uint64_t v);
+    static uint64_t compactBits(uint64_t v);
+
+    // Returns the slot of key, or the empty slot where it would be inserted
+    size_t probe(uint64_t key) const;
+    // Doubles the capacity and reinserts everything
+    void grow();
+
+public:
+    ChunkMap();
+    ChunkMap(const ChunkMap&) = default;
+    ChunkMap(ChunkMap&&) = default;
+    ChunkMap& operator=(const ChunkMap&) = default;
+    ChunkMap& operator=(ChunkMap&&) = default;
+    virtual ~ChunkMap() = default;
+
+    // True if the coordinates can be used as a key
+    static bool inRange(int x, int y, int z);
+    // Packs / unpacks chunk coordinates to / from a Morton code
+    static uint64_t encode(int x, int y, int z);
+    static void decode(uint64_t key, int &x, int &y, int &z);
+
+    // Returns a pointer to the value of a chunk, or nullptr if it's not in the map
+    V* find(int x, int y, int z);
+    const V* find(int x, int y, int z) const;
+
+    // Returns the value of a chunk, inserting a default one if it's not in the map.
+    // The bool is true if the value was inserted. Only one probe is made
+    std::pair<V*, bool> tryEmplace(int x, int y, int z);
+    V& operator()(int x, int y, int z);
+
+    // Removes a chunk. Returns false if it was not in the map
+    bool erase(int x, int y, int z);
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    // Makes room for n values without rehashing
+    void reserve(size_t n);
+
+    // Calls f(x, y, z, value) for every value in the map, in no particular order
+    template <typename F>
+    void forEach(F f);
+    template <typename F>
+    void forEach(F f) const;
+};
+
+template <typename V>
+ChunkMap<V>::ChunkMap() {
+    m_size = 0;
+    m_slots.resize(16);
+    m_mask = m_slots.size() - 1;
+}
+
+template <typename V>
+uint64_t ChunkMap<V>::mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+template <typename V>
+uint64_t ChunkMap<V>::spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+template <typename V>
+uint64_t ChunkMap<V>::compactBits(uint64_t v) {
+    v &= 0x1249249249249249ULL;
+    v = (v ^ (v >> 2))  & 0x10c30c30c30c30c3ULL;
+    v = (v ^ (v >> 4))  & 0x100f00f00f00f00fULL;
+    v = (v ^ (v >> 8))  & 0x1f0000ff0000ffULL;
+    v = (v ^ (v >> 16)) & 0x1f00000000ffffULL;
+    v = (v ^ (v >> 32)) & 0x1fffff;
+    return v;
+}
+
+template <typename V>
+bool ChunkMap<V>::inRange(int x, int y, int z) {
+    return x >= -CHUNK_COORD_LIMIT && x < CHUNK_COORD_LIMIT && y >= -CHUNK_COORD_LIMIT && y < CHUNK_COORD_LIMIT
+        && z >= -CHUNK_COORD_LIMIT && z < CHUNK_COORD_LIMIT;
+}
+
+template <typename V>
+uint64_t ChunkMap<V>::encode(int x, int y, int z) {
+    assert(inRange(x, y, z));
+
+    // Biases coordinates so that negative ones are packed without sign extension
+    const int64_t bias = CHUNK_COORD_LIMIT;
+    return spreadBits((uint64_t)(x + bias)) | spreadBits((uint64_t)(y + bias)) << 1
+        | spreadBits((uint64_t)(z + bias)) << 2;
+}
+
+template <typename V>
+void ChunkMap<V>::decode(uint64_t key, int &x, int &y, int &z) {
+    const int64_t bias = CHUNK_COORD_LIMIT;
+    x = (int)((int64_t)compactBits(key) - bias);
+    y = (int)((int64_t)compactBits(key >> 1) - bias);
+    z = (int)((int64_t)compactBits(key >> 2) - bias);
+}
+
+template <typename V>
+size_t ChunkMap<V>::probe(uint64_t key) const {
+    size_t i = mix(key) & m_mask;
+    while (m_slots[i].key != key && m_slots[i].key != EMPTY) {
+        i = (i + 1) & m_mask;
+    }
+    return i;
+}
+
+template <typename V>
+void ChunkMap<V>::grow() {
+    std::vector<Slot> old;
+    old.swap(m_slots);
+
+    m_slots.resize(2*old.size());
+    m_mask = m_slots.size() - 1;
+
+    for (Slot& slot : old) {
+        if (slot.key != EMPTY) {
+            m_slots[probe(slot.key)] = std::move(slot);
+        }
+    }
+}
+
+template <typename V>
+V* ChunkMap<V>::find(int x, int y, int z) {
+    Slot& slot = m_slots[probe(encode(x, y, z))];
+    return slot.key == EMPTY ? nullptr : &slot.value;
+}
+
+template <typename V>
+const V* ChunkMap<V>::find(int x, int y, int z) const {
+    const Slot& slot = m_slots[probe(encode(x, y, z))];
+    return slot.key == EMPTY ? nullptr : &slot.value;
+}
+
+template <typename V>
+std::pair<V*, bool> ChunkMap<V>::tryEmplace(int x, int y, int z) {
+    // Keeps the load factor under 1/2 so probe sequences stay short
+    if (2*(m_size + 1) > m_slots.size()) {
+        grow();
+    }
+
+    uint64_t key = encode(x, y, z);
+    Slot& slot = m_slots[probe(key)];
+    if (slot.key != EMPTY) {
+        return {&slot.value, false};
+    }
+
+    slot.key = key;
+    slot.value = V();
+    m_size++;
+    return {&slot.value, true};
+}
+
+template <typename V>
+V& ChunkMap<V>::operator()(int x, int y, int z) {
+    return *tryEmplace(x, y, z).first;
+}
+
+template <typename V>
+bool ChunkMap<V>::erase(int x, int y, int z) {
+    size_t i = probe(encode(x, y, z));
+    if (m_slots[i].key == EMPTY) {
+        return false;
+    }
+
+    // Backward shift deletion: moves back the following entries of the probe sequence,
+    // so no tombstones are needed
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & m_mask;
+        if (m_slots[j].key == EMPTY) {
+            break;
+        }
+
+        // Entries whose ideal slot is cyclically in (i, j] must stay where they are
+        size_t ideal = mix(m_slots[j].key) & m_mask;
+        if (((j - ideal) & m_mask) >= ((j - i) & m_mask)) {
+            m_slots[i] = std::move(m_slots[j]);
+            i = j;
+        }
+    }
+
+    m_slots[i].key = EMPTY;
+    m_slots[i].value = V();
+    m_size--;
+    return true;
+}
+
+template <typename V>
+size_t ChunkMap<V>::size() const {
+    return m_size;
+}
+
+template <typename V>
+bool ChunkMap<V>::empty() const {
+    return m_size == 0;
+}
+
+template <typename V>
+void ChunkMap<V>::clear() {
+    for (Slot& slot : m_slots) {
+        slot.key = EMPTY;
+        slot.value = V();
+    }
+    m_size = 0;
+}
+
+template <typename V>
+void ChunkMap<V>::reserve(size_t n) {
+    while (2*n > m_slots.size()) {
+        grow();
+    }
+}
+
+template <typename V>
+template <typename F>
+void ChunkMap<V>::forEach(F f) {
+    for (Slot& slot : m_slots) {
+        if (slot.key != EMPTY) {
+            int x, y, z;
+            decode(slot.key, x, y, z);
+            f(x, y, z, slot.value);
+        }
+    }
+}
+
+template <typename V>
+template <typename F>
+void ChunkMap<V>::forEach(F f) const {
+    for (const Slot& slot : m_slots) {
+        if (slot.key != EMPTY) {
+            int x, y, z;
+            decode(slot.key, x, y, z);
+            f(x, y, z, slot.value);
+        }
+    }
+}
+
+#endif
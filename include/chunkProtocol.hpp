@@ -0,0 +1,272 @@
+#ifndef CHUNK_PROTOCOL
+#define CHUNK_PROTOCOL
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+
+// Binary protocol between the chunk server and its clients. Every message is a fixed size
+// header followed by size bytes of payload. Requests carry an id that is sent back with
+// the answer, so clients can send many requests without waiting for each answer.
+// Integers are sent in host byte order: server and clients run on the same machine
+namespace net {
+
+enum MessageType : uint8_t {
+    // Client -> server: asks for the chunk at (x, y, z). No payload
+    MSG_GET_CHUNK = 1,
+    // Server -> client: the chunk at (x, y, z), payload is its compressed blocks
+    MSG_CHUNK = 2,
+    // Client -> server: saves a modified chunk, payload is its compressed blocks
+    MSG_PUT_CHUNK = 3
+};
+
+struct MessageHeader {
+    uint8_t type;
+    uint32_t requestId;
+    int32_t x, y, z;
+    // Payload size in bytes
+    uint32_t size;
+};
+
+// Bytes of a header on the wire (the struct has padding)
+const size_t HEADER_SIZE = 1 + 4*5;
+// Larger payloads are treated as a broken stream
+const uint32_t MAX_PAYLOAD_SIZE = 2*CHUNCK_SIZE*CHUNCK_SIZE*CHUNCK_SIZE;
+
+// Compresses a block grid as runs of (count, block ID) byte pairs. Most chunks are
+// all air or have a few layers of the same block, so they take a handful of bytes
+inline std::vector<uint8_t> encodeBlocks(const BlockGrid& grid) {
+    std::vector<uint8_t> out;
+    const blockType* blocks = &grid.blocks[0][0][0];
+    const int n = CHUNCK_SIZE*CHUNCK_SIZE*CHUNCK_SIZE;
+
+    for (int i = 0; i < n;) {
+        int run = 1;
+        while (i + run < n && run < 255 && blocks[i + run].ID == blocks[i].ID) {
+            run++;
+        }
+
+        out.push_back((uint8_t)run);
+        out.push_back((uint8_t)blocks[i].ID);
+        i += run;
+    }
+    return out;
+}
+
+// Decompresses a block grid. Returns false if the data is not a valid chunk
+inline bool decodeBlocks(const uint8_t* data, size_t size, BlockGrid& grid) {
+    blockType* blocks = &grid.blocks[0][0][0];
+    const size_t n = CHUNCK_SIZE*CHUNCK_SIZE*CHUNCK_SIZE;
+    const size_t blockCount = sizeof(b_blocks)/sizeof(blockType);
+
+    size_t filled = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        size_t run = data[i];
+        unsigned int id = data[i + 1];
+        if (run == 0 || filled + run > n || id >= blockCount) {
+            return false;
+        }
+
+        for (size_t j = 0; j < run; j++) {
+            blocks[filled++] = b_blocks[id];
+        }
+    }
+    return filled == n && size % 2 == 0;
+}
+
+// Appends a message to a buffer
+inline void writeMessage(std::vector<uint8_t>& out, MessageHeader header, const std::vector<uint8_t>& payload = {}) {
+    header.size = payload.size();
+
+    uint8_t bytes[HEADER_SIZE];
+    bytes[0] = header.type;
+    memcpy(bytes + 1, &header.requestId, 4);
+    memcpy(bytes + 5, &header.x, 4);
+    memcpy(bytes + 9, &header.y, 4);
+    memcpy(bytes + 13, &header.z, 4);
+    memcpy(bytes + 17, &header.size, 4);
+
+    out.insert(out.end(), bytes, bytes + HEADER_SIZE);
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// Non-blocking socket with its pending input and output
+class Connection
+{
+private:
+    int m_fd;
+    std::vector<uint8_t> m_in;
+    // Bytes of m_in already parsed
+    size_t m_inOffset;
+    std::vector<uint8_t> m_out;
+
+public:
+    Connection(int fd);
+    Connection(const Connection& other) = delete;
+    Connection& operator=(const Connection& other) = delete;
+    virtual ~Connection();
+
+    int getFd() const;
+    bool hasPendingOutput() const;
+
+    // Queues a message, it's sent by flush()
+    void send(const MessageHeader& header, const std::vector<uint8_t>& payload = {});
+    // Sends as much queued output as the socket accepts. Returns false if the connection is lost
+    bool flush();
+    // Reads the available input. Returns false if the connection is closed or lost
+    bool receive();
+    // Takes the next complete message out of the input. Returns false if there isn't one
+    // yet, or if the stream is broken (then broken is set)
+    bool next(MessageHeader& header, std::vector<uint8_t>& payload, bool& broken);
+};
+
+Connection::Connection(int fd) {
+    m_fd = fd;
+    m_inOffset = 0;
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+Connection::~Connection() {
+    close(m_fd);
+}
+
+int Connection::getFd() const {
+    return m_fd;
+}
+
+bool Connection::hasPendingOutput() const {
+    return !m_out.empty();
+}
+
+void Connection::send(const MessageHeader& header, const std::vector<uint8_t>& payload) {
+    writeMessage(m_out, header, payload);
+}
+
+bool Connection::flush() {
+    size_t sent = 0;
+    while (sent < m_out.size()) {
+        ssize_t n = ::send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+
+    m_out.erase(m_out.begin(), m_out.begin() + sent);
+    return true;
+}
+
+bool Connection::receive() {
+    // Drops input that has already been parsed
+    m_in.erase(m_in.begin(), m_in.begin() + m_inOffset);
+    m_inOffset = 0;
+
+    uint8_t buffer[16384];
+    while (true) {
+        ssize_t n = recv(m_fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            m_in.insert(m_in.end(), buffer, buffer + n);
+        } else if (n == 0) {
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool Connection::next(MessageHeader& header, std::vector<uint8_t>& payload, bool& broken) {
+    broken = false;
+    size_t available = m_in.size() - m_inOffset;
+    if (available < HEADER_SIZE) {
+        return false;
+    }
+
+    const uint8_t* bytes = m_in.data() + m_inOffset;
+    header.type = bytes[0];
+    memcpy(&header.requestId, bytes + 1, 4);
+    memcpy(&header.x, bytes + 5, 4);
+    memcpy(&header.y, bytes + 9, 4);
+    memcpy(&header.z, bytes + 13, 4);
+    memcpy(&header.size, bytes + 17, 4);
+
+    if (header.size > MAX_PAYLOAD_SIZE) {
+        broken = true;
+        return false;
+    }
+    if (available < HEADER_SIZE + header.size) {
+        return false;
+    }
+
+    payload.assign(bytes + HEADER_SIZE, bytes + HEADER_SIZE + header.size);
+    m_inOffset += HEADER_SIZE + header.size;
+    return true;
+}
+
+// Fills a Unix socket address. Returns false if the path is too long
+inline bool socketAddress(const std::string& path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+// Creates a Unix socket listening at path. Returns -1 on failure
+inline int listenSocket(const std::string& path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Removes the socket left by a previous server
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connects to the Unix socket at path. Returns -1 on failure
+inline int connectSocket(const std::string& path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}
+#endif
@@ -0,0 +1,109 @@
+#ifndef CHUNK_REMESHER
+#define CHUNK_REMESHER
+
+#include <memory>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "world.hpp"
+#include "async.hpp"
+#include "workerPool.hpp"
+
+// Remeshes edited chunks on the worker threads. Workers read the chunk's blocks from the
+// version of the world published after the edit, without locks, while the main thread
+// keeps editing and loading chunks. The mesh is handed back on the main thread
+class ChunkRemesher
+{
+private:
+    const World& m_world;
+    WorkerPool& m_pool;
+    MainThreadQueue& m_mainThread;
+
+    // Last remesh requested for each chunk: older ones still running are discarded
+    ChunkMap<uint64_t> m_latest;
+    uint64_t m_nextId;
+    size_t m_running;
+
+    size_t m_completed;
+    size_t m_discarded;
+
+    template <typename F>
+    DetachedTask run(glm::ivec3 pos, float priority, uint64_t id, F onMeshed);
+
+public:
+    ChunkRemesher(const World& world, WorkerPool& pool, MainThreadQueue& mainThread);
+    virtual ~ChunkRemesher() = default;
+
+    // Meshes a chunk from the last published world on a worker. Call after World::publish(),
+    // so that the edits are published. onMeshed(const Chunk&) gets a chunk holding the new
+    // mesh on the main thread, unless a newer remesh of the chunk was requested meanwhile or
+    // the chunk was unloaded
+    template <typename F>
+    void remesh(glm::ivec3 pos, float priority, F onMeshed);
+
+    // Remeshes not finished yet
+    size_t inFlightCount() const;
+    size_t getCompleted() const;
+    size_t getDiscarded() const;
+};
+
+ChunkRemesher::ChunkRemesher(const World& world, WorkerPool& pool, MainThreadQueue& mainThread)
+    : m_world(world), m_pool(pool), m_mainThread(mainThread) {
+    m_nextId = 0;
+    m_running = 0;
+    m_completed = 0;
+    m_discarded = 0;
+}
+
+template <typename F>
+DetachedTask ChunkRemesher::run(glm::ivec3 pos, float priority, uint64_t id, F onMeshed) {
+    m_running++;
+    co_await m_pool.schedule(pos, priority, CancelToken());
+
+    // The blocks are copied while the world is pinned, the mesh is built after
+    std::unique_ptr<Chunk> meshed = m_world.read([&](const WorldReader& reader) -> std::unique_ptr<Chunk> {
+        const BlockGrid* blocks = reader.chunkBlocks(pos);
+        return blocks == nullptr ? nullptr : std::make_unique<Chunk>(pos, *blocks, false);
+    });
+    if (meshed) {
+        meshed->buildMesh();
+    }
+
+    co_await m_mainThread.schedule();
+    m_running--;
+
+    uint64_t* latest = m_latest.find(pos.x, pos.y, pos.z);
+    if (latest == nullptr || *latest != id) {
+        m_discarded++;
+        co_return;
+    }
+    m_latest.erase(pos.x, pos.y, pos.z);
+
+    if (meshed) {
+        m_completed++;
+        onMeshed(static_cast<const Chunk&>(*meshed));
+    } else {
+        m_discarded++;
+    }
+}
+
+template <typename F>
+void ChunkRemesher::remesh(glm::ivec3 pos, float priority, F onMeshed) {
+    uint64_t id = m_nextId++;
+    m_latest(pos.x, pos.y, pos.z) = id;
+    run(pos, priority, id, onMeshed);
+}
+
+size_t ChunkRemesher::inFlightCount() const {
+    return m_running;
+}
+
+size_t ChunkRemesher::getCompleted() const {
+    return m_completed;
+}
+
+size_t ChunkRemesher::getDiscarded() const {
+    return m_discarded;
+}
+
+#endif
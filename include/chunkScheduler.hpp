@@ -0,0 +1,187 @@
+#ifndef CHUNK_SCHEDULER
+#define CHUNK_SCHEDULER
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "gamedata.hpp"
+#include "chunkMap.hpp"
+#include "chunkStore.hpp"
+
+// Added to the priority of prefetches: they only run once no chunk of a window is waiting
+#define PREFETCH_PRIORITY_TIER 1.0e6f
+
+enum ChunkTaskType {
+    // Reads or generates the chunk's blocks
+    TASK_LOAD = 1,
+    // Builds the chunk's mesh
+    TASK_MESH = 2,
+    // Loads and meshes a chunk that is predicted to enter the window soon
+    TASK_PREFETCH = 4
+};
+
+struct ChunkTask {
+    glm::ivec3 pos;
+    ChunkTaskType type;
+    // Lower runs first
+    float priority;
+};
+
+// Orders pending chunk work so that what the player sees is ready first: chunks close to
+// the player and in front of the camera go first. Work is run within a time budget per frame
+class ChunkScheduler
+{
+private:
+    // Max heap on -priority
+    std::vector<ChunkTask> m_tasks;
+    // Types of tasks pending for each chunk, to avoid queuing the same work twice
+    ChunkMap<unsigned char> m_pending;
+
+    // Viewer used for priorities
+    glm::ivec3 m_viewerChunk;
+    glm::vec3 m_viewerFront;
+
+    // Marks a task as no longer pending
+    void clearPending(const ChunkTask& task);
+    static bool compare(const ChunkTask& a, const ChunkTask& b);
+
+public:
+    ChunkScheduler();
+    virtual ~ChunkScheduler() = default;
+
+    // Queues a task, unless the same task is already pending for that chunk
+    void push(glm::ivec3 pos, ChunkTaskType type);
+
+    // Updates the viewer and recomputes every priority
+    void prioritize(glm::ivec3 viewerChunk, glm::vec3 viewerFront);
+    // Priority of a task for the current viewer, lower runs first
+    float score(glm::ivec3 pos, ChunkTaskType type) const;
+
+    // Removes every task for which cancel(task) is true
+    template <typename F>
+    void cancelIf(F cancel);
+    // Removes the load and mesh tasks of chunks that no viewer needs
+    void cancelOutside(const ChunkStore& store);
+
+    // Runs tasks in priority order with run(task) until budgetMs milliseconds have passed.
+    // At least one task is run, so work always progresses. Returns the number of tasks run
+    template <typename F>
+    int drain(double budgetMs, F run);
+
+    size_t size() const;
+    bool empty() const;
+};
+
+ChunkScheduler::ChunkScheduler() {
+    m_viewerChunk = glm::ivec3(0, 0, 0);
+    m_viewerFront = glm::vec3(0, 0, -1);
+}
+
+float ChunkScheduler::score(glm::ivec3 pos, ChunkTaskType type) const {
+    float tier = type == TASK_PREFETCH ? PREFETCH_PRIORITY_TIER : 0.0f;
+
+    glm::vec3 offset = glm::vec3(pos - m_viewerChunk);
+    float distance = glm::length(offset);
+    if (distance == 0.0f) {
+        return tier;
+    }
+
+    // Alignment goes from 1 (straight ahead) to -1 (behind): chunks behind the camera
+    // count as three times as far as chunks in front of it
+    float alignment = glm::dot(offset / distance, m_viewerFront);
+    return tier + distance*(2.0f - alignment);
+}
+
+bool ChunkScheduler::compare(const ChunkTask& a, const ChunkTask& b) {
+    // Loads of a chunk come before its mesh when priorities are equal
+    if (a.priority != b.priority) {
+        return a.priority > b.priority;
+    }
+    return a.type > b.type;
+}
+
+void ChunkScheduler::clearPending(const ChunkTask& task) {
+    unsigned char* pending = m_pending.find(task.pos.x, task.pos.y, task.pos.z);
+    if (pending != nullptr) {
+        *pending &= ~task.type;
+        if (*pending == 0) {
+            m_pending.erase(task.pos.x, task.pos.y, task.pos.z);
+        }
+    }
+}
+
+void ChunkScheduler::push(glm::ivec3 pos, ChunkTaskType type) {
+    unsigned char& pending = m_pending(pos.x, pos.y, pos.z);
+    if (pending & type) {
+        return;
+    }
+    pending |= type;
+
+    m_tasks.push_back({pos, type, score(pos, type)});
+    std::push_heap(m_tasks.begin(), m_tasks.end(), compare);
+}
+
+void ChunkScheduler::prioritize(glm::ivec3 viewerChunk, glm::vec3 viewerFront) {
+    m_viewerChunk = viewerChunk;
+    m_viewerFront = viewerFront;
+
+    for (ChunkTask& task : m_tasks) {
+        task.priority = score(task.pos, task.type);
+    }
+    std::make_heap(m_tasks.begin(), m_tasks.end(), compare);
+}
+
+template <typename F>
+void ChunkScheduler::cancelIf(F cancel) {
+    auto removed = [&](const ChunkTask& task) {
+        if (!cancel(task)) {
+            return false;
+        }
+
+        clearPending(task);
+        return true;
+    };
+
+    m_tasks.erase(std::remove_if(m_tasks.begin(), m_tasks.end(), removed), m_tasks.end());
+    std::make_heap(m_tasks.begin(), m_tasks.end(), compare);
+}
+
+void ChunkScheduler::cancelOutside(const ChunkStore& store) {
+    cancelIf([&](const ChunkTask& task) {
+        return task.type != TASK_PREFETCH && !store.isNeeded(task.pos);
+    });
+}
+
+template <typename F>
+int ChunkScheduler::drain(double budgetMs, F run) {
+    auto start = std::chrono::steady_clock::now();
+    int count = 0;
+
+    while (!m_tasks.empty()) {
+        std::pop_heap(m_tasks.begin(), m_tasks.end(), compare);
+        ChunkTask task = m_tasks.back();
+        m_tasks.pop_back();
+
+        clearPending(task);
+
+        // Tasks can push more tasks (e.g. a load pushes the mesh of the chunk)
+        run(task);
+        count++;
+
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetMs) {
+            break;
+        }
+    }
+    return count;
+}
+
+size_t ChunkScheduler::size() const {
+    return m_tasks.size();
+}
+
+bool ChunkScheduler::empty() const {
+    return m_tasks.empty();
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef CHUNK_STORE
+#define CHUNK_STORE
+
+#include <memory>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+
+// A chunk needed by at least one viewer. chunk is null while it's being loaded
+struct StoredChunk {
+    std::unique_ptr<Chunk> chunk;
+    // Viewers whose interest region contains the chunk
+    unsigned int refs = 0;
+};
+
+// Every chunk needed by any viewer, keyed by world chunk coordinates. Viewers (ChunkWindow)
+// take a reference on each chunk of their interest region: a chunk is loaded once however
+// many viewers need it, and is released when the last one stops needing it
+class ChunkStore
+{
+private:
+    ChunkMap<StoredChunk> m_chunks;
+    size_t m_loaded;
+    // Chunks loaded, released or edited since the last takeChanges()
+    ChunkMap<bool> m_changed;
+
+public:
+    ChunkStore();
+    virtual ~ChunkStore() = default;
+
+    // Adds a reference to a chunk. Returns true if it's the first one: the chunk has to be loaded
+    bool acquire(glm::ivec3 chunkPos);
+    // Removes a reference to a chunk. When it was the last one, the chunk (if it was loaded)
+    // is passed to onRelease
+    template <typename F>
+    void release(glm::ivec3 chunkPos, F onRelease);
+
+    // True if at least one viewer needs the chunk (loaded or not)
+    bool isNeeded(glm::ivec3 chunkPos) const;
+    unsigned int getRefCount(glm::ivec3 chunkPos) const;
+
+    // Returns the chunk at a chunk position, or nullptr if no viewer needs it or it's not loaded
+    Chunk* at(glm::ivec3 chunkPos) const;
+    // Stores a loaded chunk. Chunks no viewer needs are discarded
+    void set(std::unique_ptr<Chunk> chunk);
+    // Records that the blocks of a loaded chunk were edited
+    void markChanged(glm::ivec3 chunkPos);
+    // Calls f(chunkPos) for every chunk loaded, released or edited since the last call
+    template <typename F>
+    void takeChanges(F f);
+
+    // Calls f(chunk) for every loaded chunk
+    template <typename F>
+    void forEachLoaded(F f);
+    template <typename F>
+    void forEachLoaded(F f) const;
+    size_t loadedCount() const;
+    // Chunks needed by a viewer, loaded or not
+    size_t neededCount() const;
+};
+
+ChunkStore::ChunkStore() {
+    m_loaded = 0;
+}
+
+bool ChunkStore::acquire(glm::ivec3 chunkPos) {
+    StoredChunk& stored = m_chunks(chunkPos.x, chunkPos.y, chunkPos.z);
+    return stored.refs++ == 0;
+}
+
+template <typename F>
+void ChunkStore::release(glm::ivec3 chunkPos, F onRelease) {
+    StoredChunk* stored = m_chunks.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (stored == nullptr || --stored->refs > 0) {
+        return;
+    }
+
+    std::unique_ptr<Chunk> chunk = std::move(stored->chunk);
+    m_chunks.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (chunk) {
+        m_loaded--;
+        markChanged(chunkPos);
+        onRelease(std::move(chunk));
+    }
+}
+
+bool ChunkStore::isNeeded(glm::ivec3 chunkPos) const {
+    return m_chunks.find(chunkPos.x, chunkPos.y, chunkPos.z) != nullptr;
+}
+
+unsigned int ChunkStore::getRefCount(glm::ivec3 chunkPos) const {
+    const StoredChunk* stored = m_chunks.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    return stored == nullptr ? 0 : stored->refs;
+}
+
+Chunk* ChunkStore::at(glm::ivec3 chunkPos) const {
+    const StoredChunk* stored = m_chunks.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    return stored == nullptr ? nullptr : stored->chunk.get();
+}
+
+void ChunkStore::set(std::unique_ptr<Chunk> chunk) {
+    glm::ivec3 chunkPos = chunk->getChunkPos();
+    StoredChunk* stored = m_chunks.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (stored == nullptr) {
+        return;
+    }
+
+    m_loaded += stored->chunk ? 0 : 1;
+    stored->chunk = std::move(chunk);
+    markChanged(chunkPos);
+}
+
+void ChunkStore::markChanged(glm::ivec3 chunkPos) {
+    m_changed(chunkPos.x, chunkPos.y, chunkPos.z) = true;
+}
+
+template <typename F>
+void ChunkStore::takeChanges(F f) {
+    m_changed.forEach([&](int x, int y, int z, bool&) {
+        f(glm::ivec3(x, y, z));
+    });
+    m_changed.clear();
+}
+
+template <typename F>
+void ChunkStore::forEachLoaded(F f) {
+    m_chunks.forEach([&](int, int, int, StoredChunk& stored) {
+        if (stored.chunk) {
+            f(*stored.chunk);
+        }
+    });
+}
+
+template <typename F>
+void ChunkStore::forEachLoaded(F f) const {
+    m_chunks.forEach([&](int, int, int, const StoredChunk& stored) {
+        if (stored.chunk) {
+            f(*stored.chunk);
+        }
+    });
+}
+
+size_t ChunkStore::loadedCount() const {
+    return m_loaded;
+}
+
+size_t ChunkStore::neededCount() const {
+    return m_chunks.size();
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef CHUNK_WINDOW
+#define CHUNK_WINDOW
+
+#include <vector>
+#include <memory>
+#include "chunk.hpp"
+#include "chunkStore.hpp"
+#include "gamedata.hpp"
+
+// Interest region of a viewer: a cube of chunks around it. The chunks themselves are in a
+// ChunkStore shared by every viewer, the window holds a reference on each of its chunks
+// so that they stay loaded while it needs them
+class ChunkWindow
+{
+private:
+    ChunkStore& m_store;
+    int m_radius;
+    // Number of chunks along each side: 2*radius + 1
+    int m_side;
+    // Chunk position at the center of the window
+    glm::ivec3 m_center;
+    // False until the window is first placed, and after leave(): it holds no reference
+    bool m_placed;
+    // Chunks loaded for another viewer that entered the window, or left it but stay
+    // loaded, during the last recenter() or resize()
+    std::vector<glm::ivec3> m_sharedEntered;
+    std::vector<glm::ivec3> m_sharedLeft;
+
+    // True if a chunk position is inside the cube of a center and radius
+    static bool inside(glm::ivec3 chunkPos, glm::ivec3 center, int radius);
+
+    // Moves the window to a new center and radius, see recenter()
+    template <typename F>
+    std::vector<glm::ivec3> reshape(glm::ivec3 center, int radius, F onEvict);
+
+public:
+    ChunkWindow(ChunkStore& store, int radius);
+    virtual ~ChunkWindow() = default;
+
+    int getRadius() const;
+    int getSide() const;
+    glm::ivec3 getCenter() const;
+    ChunkStore& getStore() const;
+
+    // True if a chunk position is inside the window (loaded or not)
+    bool contains(glm::ivec3 chunkPos) const;
+
+    // Returns the chunk at a chunk position, or nullptr if it's outside the window or not loaded
+    Chunk* at(glm::ivec3 chunkPos) const;
+    // Places a loaded chunk in the store. Chunks no viewer needs are discarded
+    void set(std::unique_ptr<Chunk> chunk);
+
+    // Moves the window to a new center. Chunks that no viewer needs anymore are passed to
+    // onEvict. Returns the positions that entered the window and have to be loaded: chunks
+    // already loaded for another viewer are shared
+    template <typename F>
+    std::vector<glm::ivec3> recenter(glm::ivec3 center, F onEvict);
+    std::vector<glm::ivec3> recenter(glm::ivec3 center);
+    // Changes the radius around the same center, keeping the chunks that are still inside
+    template <typename F>
+    std::vector<glm::ivec3> resize(int radius, F onEvict);
+    // Chunks of another viewer that entered or left the window during the last move
+    const std::vector<glm::ivec3>& getSharedEntered() const;
+    const std::vector<glm::ivec3>& getSharedLeft() const;
+    // Drops every reference of the window, for a viewer that goes away
+    template <typename F>
+    void leave(F onEvict);
+
+    // Calls f(chunk) for every loaded chunk of the window
+    template <typename F>
+    void forEachLoaded(F f) const;
+    size_t loadedCount() const;
+};
+
+ChunkWindow::ChunkWindow(ChunkStore& store, int radius) : m_store(store) {
+    m_radius = radius;
+    m_side = 2*radius + 1;
+    m_center = glm::ivec3(0, 0, 0);
+    m_placed = false;
+}
+
+bool ChunkWindow::inside(glm::ivec3 chunkPos, glm::ivec3 center, int radius) {
+    glm::ivec3 rel = glm::abs(chunkPos - center);
+    return rel.x <= radius && rel.y <= radius && rel.z <= radius;
+}
+
+int ChunkWindow::getRadius() const {
+    return m_radius;
+}
+
+int ChunkWindow::getSide() const {
+    return m_side;
+}
+
+glm::ivec3 ChunkWindow::getCenter() const {
+    return m_center;
+}
+
+ChunkStore& ChunkWindow::getStore() const {
+    return m_store;
+}
+
+bool ChunkWindow::contains(glm::ivec3 chunkPos) const {
+    return m_placed && inside(chunkPos, m_center, m_radius);
+}
+
+Chunk* ChunkWindow::at(glm::ivec3 chunkPos) const {
+    if (!contains(chunkPos)) {
+        return nullptr;
+    }
+    return m_store.at(chunkPos);
+}
+
+void ChunkWindow::set(std::unique_ptr<Chunk> chunk) {
+    m_store.set(std::move(chunk));
+}
+
+template <typename F>
+std::vector<glm::ivec3> ChunkWindow::reshape(glm::ivec3 center, int radius, F onEvict) {
+    glm::ivec3 oldCenter = m_center;
+    int oldRadius = m_radius;
+    bool wasPlaced = m_placed;
+
+    m_center = center;
+    m_radius = radius;
+    m_side = 2*radius + 1;
+    m_placed = true;
+    m_sharedEntered.clear();
+    m_sharedLeft.clear();
+
+    // References are taken on the new chunks before the old ones are dropped, so chunks in
+    // both windows are never released in between
+    std::vector<glm::ivec3> missing;
+    for (int i = -radius; i <= radius; i++) {
+        for (int j = -radius; j <= radius; j++) {
+            for (int k = -radius; k <= radius; k++) {
+                glm::ivec3 pos = center + glm::ivec3(i, j, k);
+                if (wasPlaced && inside(pos, oldCenter, oldRadius)) {
+                    continue;
+                }
+
+                m_store.acquire(pos);
+                if (m_store.at(pos) == nullptr) {
+                    missing.push_back(pos);
+                } else {
+                    m_sharedEntered.push_back(pos);
+                }
+            }
+        }
+    }
+
+    if (wasPlaced) {
+        for (int i = -oldRadius; i <= oldRadius; i++) {
+            for (int j = -oldRadius; j <= oldRadius; j++) {
+                for (int k = -oldRadius; k <= oldRadius; k++) {
+                    glm::ivec3 pos = oldCenter + glm::ivec3(i, j, k);
+                    if (!inside(pos, center, radius)) {
+                        m_store.release(pos, onEvict);
+                        if (m_store.at(pos) != nullptr) {
+                            m_sharedLeft.push_back(pos);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return missing;
+}
+
+template <typename F>
+std::vector<glm::ivec3> ChunkWindow::recenter(glm::ivec3 center, F onEvict) {
+    return reshape(center, m_radius, onEvict);
+}
+
+std::vector<glm::ivec3> ChunkWindow::recenter(glm::ivec3 center) {
+    return recenter(center, [](std::unique_ptr<Chunk>) {});
+}
+
+template <typename F>
+std::vector<glm::ivec3> ChunkWindow::resize(int radius, F onEvict) {
+    if (!m_placed) {
+        m_radius = radius;
+        m_side = 2*radius + 1;
+        return {};
+    }
+    return reshape(m_center, radius, onEvict);
+}
+
+const std::vector<glm::ivec3>& ChunkWindow::getSharedEntered() const {
+    return m_sharedEntered;
+}
+
+const std::vector<glm::ivec3>& ChunkWindow::getSharedLeft() const {
+    return m_sharedLeft;
+}
+
+template <typename F>
+void ChunkWindow::leave(F onEvict) {
+    if (!m_placed) {
+        return;
+    }
+
+    for (int i = -m_radius; i <= m_radius; i++) {
+        for (int j = -m_radius; j <= m_radius; j++) {
+            for (int k = -m_radius; k <= m_radius; k++) {
+                m_store.release(m_center + glm::ivec3(i, j, k), onEvict);
+            }
+        }
+    }
+    m_placed = false;
+}
+
+template <typename F>
+void ChunkWindow::forEachLoaded(F f) const {
+    m_store.forEachLoaded([&](const Chunk& chunk) {
+        if (contains(chunk.getChunkPos())) {
+            f(chunk);
+        }
+    });
+}
+
+size_t ChunkWindow::loadedCount() const {
+    size_t count = 0;
+    forEachLoaded([&](const Chunk&) {
+        count++;
+    });
+    return count;
+}
+
+#endif
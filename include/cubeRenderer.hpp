@@ -0,0 +1,153 @@
+#ifndef CUBE_RENDERER
+#define CUBE_RENDERER
+
+#include <glad/glad.h>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkWindow.hpp"
+
+// Local block coordinates are packed in 8 bits each
+static_assert(CHUNCK_SIZE <= 256);
+
+// Way the chunks of the window are drawn
+enum RenderMode {
+    // One mesh per chunk with only the visible faces, rebuilt when a block changes
+    RENDER_MESHED,
+    // One instance of the cube template per visible block: changing a block only
+    // rebuilds the instance list, but hidden faces of visible blocks are drawn too
+    RENDER_INSTANCED
+};
+
+// Draws the cube template of b_vertices/b_indices once per visible block of the window.
+// Every instance is an ivec4: the chunk position, and the block packed as
+// x | y << 8 | z << 16 | ID << 24. The vertex shader offsets it from the camera's chunk
+class CubeRenderer
+{
+private:
+    GLuint m_VAO;
+    GLuint m_cubeVBO;
+    GLuint m_cubeEBO;
+    GLuint m_instanceVBO;
+    // Instances the buffer can hold without being reallocated
+    size_t m_capacity;
+
+    std::vector<glm::ivec4> m_instances;
+
+public:
+    CubeRenderer();
+    virtual ~CubeRenderer() = default;
+
+    // Creates the cube buffers and the VAO
+    void create();
+
+    // Rebuilds the instances from the visible blocks of every meshed chunk of the window
+    void build(const ChunkWindow& window);
+    // Draws every instance with a single call
+    void draw() const;
+
+    size_t getInstanceCount() const;
+    // Number of triangles drawn
+    size_t triangleCount() const;
+    void Delete();
+};
+
+CubeRenderer::CubeRenderer() {
+    m_VAO = 0;
+    m_cubeVBO = 0;
+    m_cubeEBO = 0;
+    m_instanceVBO = 0;
+    m_capacity = 0;
+}
+
+void CubeRenderer::create() {
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_cubeVBO);
+    glGenBuffers(1, &m_cubeEBO);
+    glGenBuffers(1, &m_instanceVBO);
+
+    glBindVertexArray(m_VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_cubeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(b_vertices), b_vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(b_indices), b_indices, GL_STATIC_DRAW);
+
+    // Position and texture coordinates of the template
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    // One chunk position and packed block per instance
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    glVertexAttribIPointer(2, 4, GL_INT, sizeof(glm::ivec4), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void CubeRenderer::build(const ChunkWindow& window) {
+    m_instances.clear();
+
+    window.forEachLoaded([&](const Chunk& chunk) {
+        // Same chunks as the meshed path draws
+        if (!chunk.isMeshed() || chunk.isEmpty()) {
+            return;
+        }
+
+        glm::ivec3 pos = chunk.getChunkPos();
+        for (int x = 0; x < CHUNCK_SIZE; x++) {
+            for (int y = 0; y < CHUNCK_SIZE; y++) {
+                uint64_t row = chunk.getExposedRow(x, y);
+                while (row != 0) {
+                    int z = __builtin_ctzll(row);
+                    row &= row - 1;
+
+                    int id = chunk.getBlock(x, y, z).ID;
+                    m_instances.push_back(glm::ivec4(pos.x, pos.y, pos.z, x | y << 8 | z << 16 | id << 24));
+                }
+            }
+        }
+    });
+
+    // Grows the buffer by doubling, otherwise only orphans its storage
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    if (m_instances.size() > m_capacity) {
+        m_capacity = std::max(m_instances.size(), 2*m_capacity);
+    }
+    glBufferData(GL_ARRAY_BUFFER, m_capacity*sizeof(glm::ivec4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_instances.size()*sizeof(glm::ivec4), m_instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CubeRenderer::draw() const {
+    if (m_instances.empty()) {
+        return;
+    }
+
+    glBindVertexArray(m_VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, sizeof(b_indices)/sizeof(unsigned int), GL_UNSIGNED_INT, (void*)0, m_instances.size());
+}
+
+size_t CubeRenderer::getInstanceCount() const {
+    return m_instances.size();
+}
+
+size_t CubeRenderer::triangleCount() const {
+    return m_instances.size()*(sizeof(b_indices)/sizeof(unsigned int))/3;
+}
+
+void CubeRenderer::Delete() {
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_cubeVBO);
+    glDeleteBuffers(1, &m_cubeEBO);
+    glDeleteBuffers(1, &m_instanceVBO);
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef EPOCH
+#define EPOCH
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+// Epoch based reclamation. Readers pin the current epoch while they use shared objects, the
+// writer retires objects it has unlinked instead of freeing them. The epoch only advances
+// once every reader of the previous epoch has left, so an object retired in epoch e can't be
+// reached by any reader once the epoch is e + 2, and is freed then.
+// Pinning is two atomic operations on a counter and never waits for the writer
+class EpochDomain
+{
+private:
+    // Readers pinned in even and odd epochs. Each counter has its own cache line
+    struct alignas(64) ReaderCount {
+        std::atomic<uint64_t> count{0};
+    };
+
+    std::atomic<uint64_t> m_epoch;
+    ReaderCount m_readers[2];
+
+    // Retired objects, oldest first. The shared_ptr's deleter frees them
+    struct Retired {
+        uint64_t epoch;
+        std::shared_ptr<const void> object;
+    };
+    std::deque<Retired> m_retired;
+
+    size_t m_freed;
+
+public:
+    // Keeps the epoch pinned while it's alive
+    class Guard
+    {
+    private:
+        EpochDomain* m_domain;
+        int m_parity;
+
+    public:
+        Guard(EpochDomain& domain);
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        virtual ~Guard();
+    };
+
+    EpochDomain();
+    virtual ~EpochDomain() = default;
+
+    // Pins the current epoch, for reader threads
+    Guard pin();
+
+    // Writer only: frees the object once no reader can still hold it
+    void retire(std::shared_ptr<const void> object);
+    // Writer only: advances the epoch if possible and frees the objects that are safe
+    void collect();
+
+    uint64_t getEpoch() const;
+    size_t retiredCount() const;
+    size_t freedCount() const;
+};
+
+EpochDomain::Guard::Guard(EpochDomain& domain) {
+    m_domain = &domain;
+
+    // The epoch is read again after the count is taken: if it moved meanwhile the writer
+    // may not have seen us, so we retry in the new epoch
+    while (true) {
+        uint64_t epoch = domain.m_epoch.load();
+        m_parity = epoch & 1;
+        domain.m_readers[m_parity].count.fetch_add(1);
+        if (domain.m_epoch.load() == epoch) {
+            break;
+        }
+        domain.m_readers[m_parity].count.fetch_sub(1);
+    }
+}
+
+EpochDomain::Guard::~Guard() {
+    m_domain->m_readers[m_parity].count.fetch_sub(1);
+}
+
+EpochDomain::EpochDomain() {
+    m_epoch = 2;
+    m_freed = 0;
+}
+
+EpochDomain::Guard EpochDomain::pin() {
+    return Guard(*this);
+}
+
+void EpochDomain::retire(std::shared_ptr<const void> object) {
+    m_retired.push_back({m_epoch.load(), std::move(object)});
+}
+
+void EpochDomain::collect() {
+    // Readers are only in the current epoch or the previous one. The epoch moves once the
+    // previous one is empty
+    uint64_t epoch = m_epoch.load();
+    if (m_readers[(epoch - 1) & 1].count.load() == 0) {
+        m_epoch.store(++epoch);
+    }
+
+    while (!m_retired.empty() && m_retired.front().epoch + 2 <= epoch) {
+        m_retired.pop_front();
+        m_freed++;
+    }
+}
+
+uint64_t EpochDomain::getEpoch() const {
+    return m_epoch.load();
+}
+
+size_t EpochDomain::retiredCount() const {
+    return m_retired.size();
+}
+
+size_t EpochDomain::freedCount() const {
+    return m_freed;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef FRAME_REPORT
+#define FRAME_REPORT
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sys/resource.h>
+#include "gamedata.hpp"
+
+// Frame time and memory measurements of a session, summarized at the end so that replays
+// of the same recording can be compared between builds
+class FrameReport
+{
+private:
+    // Whole frame, CPU work of the frame, and the part of it spent loading chunks, in ms
+    std::vector<float> m_frameMs;
+    std::vector<float> m_cpuMs;
+    std::vector<float> m_loadMs;
+
+    // High-water marks, in bytes
+    size_t m_peakChunkBytes;
+    size_t m_peakMeshBytes;
+    size_t m_peakCacheBytes;
+    size_t m_peakLoadedChunks;
+
+    // Value below which p percent of the samples are
+    static double percentile(std::vector<float> samples, double p);
+
+public:
+    FrameReport();
+    virtual ~FrameReport() = default;
+
+    void addFrame(double frameMs, double cpuMs, double loadMs);
+    void sampleMemory(size_t loadedChunks, size_t chunkBytes, size_t meshBytes, size_t cacheBytes);
+
+    size_t getFrameCount() const;
+    // Frames slower than twice the median and than the target. A chunk load hitch is one
+    // where loading chunks took at least half of the frame's CPU time
+    size_t hitchCount(double targetMs, bool chunkLoadsOnly) const;
+
+    void print(std::ostream& out, double targetMs) const;
+};
+
+FrameReport::FrameReport() {
+    m_peakChunkBytes = 0;
+    m_peakMeshBytes = 0;
+    m_peakCacheBytes = 0;
+    m_peakLoadedChunks = 0;
+}
+
+double FrameReport::percentile(std::vector<float> samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+
+    // Nearest rank
+    size_t rank = std::min(samples.size() - 1, (size_t)std::ceil(p/100.0*samples.size()) - (p > 0 ? 1 : 0));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+void FrameReport::addFrame(double frameMs, double cpuMs, double loadMs) {
+    m_frameMs.push_back(frameMs);
+    m_cpuMs.push_back(cpuMs);
+    m_loadMs.push_back(loadMs);
+}
+
+void FrameReport::sampleMemory(size_t loadedChunks, size_t chunkBytes, size_t meshBytes, size_t cacheBytes) {
+    m_peakLoadedChunks = std::max(m_peakLoadedChunks, loadedChunks);
+    m_peakChunkBytes = std::max(m_peakChunkBytes, chunkBytes);
+    m_peakMeshBytes = std::max(m_peakMeshBytes, meshBytes);
+    m_peakCacheBytes = std::max(m_peakCacheBytes, cacheBytes);
+}
+
+size_t FrameReport::getFrameCount() const {
+    return m_frameMs.size();
+}
+
+size_t FrameReport::hitchCount(double targetMs, bool chunkLoadsOnly) const {
+    double threshold = std::max(2.0*percentile(m_frameMs, 50), targetMs);
+
+    size_t count = 0;
+    for (size_t i = 0; i < m_frameMs.size(); i++) {
+        if (m_frameMs[i] > threshold && (!chunkLoadsOnly || m_loadMs[i] >= 0.5*m_cpuMs[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void FrameReport::print(std::ostream& out, double targetMs) const {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out << "frames " << m_frameMs.size() << "\n";
+    const double points[] = {50, 90, 99, 99.9, 100};
+    const char* names[] = {"p50", "p90", "p99", "p99.9", "max"};
+    for (int i = 0; i < 5; i++) {
+        out << "frame_ms_" << names[i] << " " << percentile(m_frameMs, points[i])
+            << "  cpu_ms_" << names[i] << " " << percentile(m_cpuMs, points[i])
+            << "  load_ms_" << names[i] << " " << percentile(m_loadMs, points[i]) << "\n";
+    }
+    out << "hitches " << hitchCount(targetMs, false) << "\n";
+    out << "chunk_load_hitches " << hitchCount(targetMs, true) << "\n";
+    out << "peak_loaded_chunks " << m_peakLoadedChunks << "\n";
+    out << "peak_chunk_kb " << m_peakChunkBytes/1024 << "\n";
+    out << "peak_mesh_kb " << m_peakMeshBytes/1024 << "\n";
+    out << "peak_cache_kb " << m_peakCacheBytes/1024 << "\n";
+    // ru_maxrss is in kilobytes on Linux
+    out << "peak_rss_kb " << usage.ru_maxrss << "\n";
+}
+
+#endif
@@ -8,8 +8,57 @@
 #define RENDER_DISTANCE 10
 #define CHUNCK_SIZE 5
 
-// Function for accessing active Chunk data
-#define IDX(x,y,z) ((x) + (y)*(2*RENDER_DISTANCE + 1) + (z)*(2*RENDER_DISTANCE + 1)*(2*RENDER_DISTANCE + 1))
+// Time per frame given to loading and meshing chunks, in milliseconds
+#define CHUNK_LOAD_BUDGET_MS 4.0
+// While chunks are loading, work over the whole window (e.g. rebuilding the cube instances)
+// is batched and done at most once per this many milliseconds
+#define WINDOW_REBUILD_INTERVAL_MS 100.0
+
+// Adaptive render distance: frame time to hold in milliseconds (0 keeps RENDER_DISTANCE),
+// the range of the radius, and the pending chunk work above which it doesn't grow
+#define FRAME_TIME_TARGET_MS 16.6
+#define MIN_RENDER_DISTANCE 4
+#define MAX_RENDER_DISTANCE 16
+#define RENDER_DISTANCE_MAX_BACKLOG 64
+
+// Chunk prefetching: how far ahead the player's motion is extrapolated
+// and how much position history is used to estimate it, in seconds
+#define PREFETCH_SECONDS 1.0f
+#define PREFETCH_HISTORY_SECONDS 0.25f
+
+// Memory given to chunks and meshes that left the window, in megabytes
+#define CHUNK_CACHE_MB 64
+
+// World file, relative to the build directory
+#define WORLD_FILE "../world.dat"
+// Bump when the world generator's output changes. Worlds keep generating new chunks with the
+// version they were created with: 1 is the base terrain, 2 adds caves and boulders
+#define WORLD_GENERATOR_VERSION 2
+// Modified chunks are saved in the background at this interval, in seconds
+#define AUTOSAVE_SECONDS 30.0f
+// Meshes of chunks from previous sessions, relative to the build directory
+#define MESH_CACHE_FILE "../world.meshcache"
+
+// Default Unix socket of the chunk server
+#define CHUNK_SERVER_SOCKET "../chunkserver.sock"
+
+// GPU memory for chunk meshes, and the staging ring used to upload them
+#define MESH_ARENA_MB 64
+#define STAGING_RING_MB 8
+// Mesh data uploaded per frame at most, in kilobytes
+#define UPLOAD_BUDGET_KB 1024
+// Chunk meshes are allocated in pages of this many quads
+#define MESH_PAGE_QUADS 64
+
+// Floats per chunk vertex: position (3), texture coordinates (2), texture layer (1)
+#define VERTEX_SIZE 6
+// Bump when the chunk mesher's output changes, so that cached meshes are rebuilt
+#define MESHER_VERSION 1
+
+// Block ticks
+#define TICKS_PER_SECOND 20
+#define MAX_TICKS_PER_FRAME 5
+#define GRAVITY_TICK_DELAY 1
 
 // for debug
 #define DEBUG
@@ -38,6 +87,9 @@ struct idTexture
     const char* filename;
 };
 
+// Bump when the format of the preprocessed texture cache changes
+#define TEXTURE_CACHE_VERSION 1
+
 inline idTexture t_texturesIDs[] =
 {
     /* 0 - dirt */  {0, "../textures/0_dirt.jpg"},
@@ -0,0 +1,179 @@
+#ifndef GPU_TIMER
+#define GPU_TIMER
+
+#include <glad/glad.h>
+#include <iostream>
+#include "gamedata.hpp"
+
+// Frames of queries in flight. Results are read this many frames later, when the GPU
+// is done with them, so reading never waits for the GPU
+#define GPU_TIMER_FRAMES 4
+
+// Parts of a frame timed on the GPU
+enum GpuPhase {
+    // Mesh copies out of the staging ring
+    GPU_PHASE_UPLOAD,
+    // Chunk draws
+    GPU_PHASE_DRAW,
+    GPU_PHASE_COUNT
+};
+
+// Measures the GPU time of each phase of a frame with GL_TIME_ELAPSED queries.
+// Phases can't overlap: a phase ends before the next one begins
+class GpuTimer
+{
+private:
+    GLuint m_queries[GPU_TIMER_FRAMES][GPU_PHASE_COUNT];
+    // True if the query has been issued and its result not read yet
+    bool m_pending[GPU_TIMER_FRAMES][GPU_PHASE_COUNT];
+    // Frame whose queries are being issued
+    int m_frame;
+    // Phase currently measured, or -1
+    int m_active;
+    bool m_supported;
+
+    // Last results, in milliseconds
+    double m_phaseMs[GPU_PHASE_COUNT];
+    bool m_hasResults;
+
+    // Reads the results that are available, without waiting
+    void collect();
+
+public:
+    GpuTimer();
+    virtual ~GpuTimer() = default;
+
+    // Creates the queries. Timing is disabled if the driver has no timer
+    void create();
+    bool isSupported() const;
+
+    void begin(GpuPhase phase);
+    void end();
+    // Moves to the next frame's queries. Call once per frame
+    void endFrame();
+
+    // True once a result has been read
+    bool hasResults() const;
+    // Last GPU time of a phase, and of the whole frame, in milliseconds
+    double getPhaseMs(GpuPhase phase) const;
+    double getFrameMs() const;
+    void Delete();
+};
+
+GpuTimer::GpuTimer() {
+    m_frame = 0;
+    m_active = -1;
+    m_supported = false;
+    m_hasResults = false;
+    for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+        for (int j = 0; j < GPU_PHASE_COUNT; j++) {
+            m_queries[i][j] = 0;
+            m_pending[i][j] = false;
+        }
+    }
+    for (int j = 0; j < GPU_PHASE_COUNT; j++) {
+        m_phaseMs[j] = 0.0;
+    }
+}
+
+void GpuTimer::create() {
+    // Timer queries are core in OpenGL 3.3, but a driver can have a counter of 0 bits
+    GLint bits = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+    m_supported = bits > 0;
+
+    #ifdef DEBUG
+    std::cout << "GPU timer: " << (m_supported ? "supported" : "not supported") << "\n";
+    #endif
+
+    if (m_supported) {
+        glGenQueries(GPU_TIMER_FRAMES*GPU_PHASE_COUNT, &m_queries[0][0]);
+    }
+}
+
+bool GpuTimer::isSupported() const {
+    return m_supported;
+}
+
+void GpuTimer::begin(GpuPhase phase) {
+    if (!m_supported || m_active >= 0) {
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[m_frame][phase]);
+    m_pending[m_frame][phase] = true;
+    m_active = phase;
+}
+
+void GpuTimer::end() {
+    if (m_active < 0) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_active = -1;
+}
+
+void GpuTimer::collect() {
+    // Oldest frame first (the one about to be reused), so the results kept are the most recent
+    for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+        int frame = (m_frame + i) % GPU_TIMER_FRAMES;
+
+        for (int phase = 0; phase < GPU_PHASE_COUNT; phase++) {
+            if (!m_pending[frame][phase]) {
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(m_queries[frame][phase], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(m_queries[frame][phase], GL_QUERY_RESULT, &elapsed);
+            m_phaseMs[phase] = elapsed / 1e6;
+            m_pending[frame][phase] = false;
+            m_hasResults = true;
+        }
+    }
+}
+
+void GpuTimer::endFrame() {
+    if (!m_supported) {
+        return;
+    }
+    end();
+
+    m_frame = (m_frame + 1) % GPU_TIMER_FRAMES;
+    collect();
+
+    // Results the GPU is still late on are dropped rather than waited for
+    for (int phase = 0; phase < GPU_PHASE_COUNT; phase++) {
+        m_pending[m_frame][phase] = false;
+    }
+}
+
+bool GpuTimer::hasResults() const {
+    return m_hasResults;
+}
+
+double GpuTimer::getPhaseMs(GpuPhase phase) const {
+    return m_phaseMs[phase];
+}
+
+double GpuTimer::getFrameMs() const {
+    double total = 0.0;
+    for (int phase = 0; phase < GPU_PHASE_COUNT; phase++) {
+        total += m_phaseMs[phase];
+    }
+    return total;
+}
+
+void GpuTimer::Delete() {
+    if (m_supported) {
+        glDeleteQueries(GPU_TIMER_FRAMES*GPU_PHASE_COUNT, &m_queries[0][0]);
+    }
+}
+
+#endif
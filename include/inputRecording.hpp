@@ -0,0 +1,159 @@
+#ifndef INPUT_RECORDING
+#define INPUT_RECORDING
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "gamedata.hpp"
+
+// Bump when InputFrame changes
+#define INPUT_RECORDING_VERSION 1
+
+enum InputFlag {
+    // The cursor moved: the camera turns towards cursorX, cursorY
+    INPUT_LOOK = 1,
+    // F2 and F3 were pressed
+    INPUT_SWITCH_RENDERER = 2,
+    INPUT_TOGGLE_HUD = 4
+};
+
+// Everything the player did in one frame, and the frame's time step
+struct InputFrame {
+    // Seconds simulated by the frame
+    float deltaTime;
+    float cursorX, cursorY;
+    // MoveKey bits
+    uint8_t moveKeys;
+    // InputFlag bits
+    uint8_t flags;
+    uint16_t padding;
+};
+
+// Header of an input recording file, followed by one InputFrame per frame
+struct InputRecordingHeader {
+    char magic[4];
+    uint32_t version;
+};
+
+// Writes the input of every frame to a file
+class InputRecorder
+{
+private:
+    std::ofstream m_file;
+    size_t m_frames;
+
+public:
+    InputRecorder();
+    virtual ~InputRecorder() = default;
+
+    bool open(const std::string& path);
+    bool isOpen() const;
+    void record(const InputFrame& frame);
+    void close();
+
+    size_t getFrameCount() const;
+};
+
+// Plays back a recording frame by frame. The time steps are the recorded ones, so the
+// player follows the same path whatever the frame rate of the replay
+class InputReplay
+{
+private:
+    std::vector<InputFrame> m_frames;
+    size_t m_next;
+
+public:
+    InputReplay();
+    virtual ~InputReplay() = default;
+
+    bool load(const std::string& path);
+    bool isLoaded() const;
+    // Gives the next frame's input. Returns false once every frame has been played
+    bool next(InputFrame& frame);
+
+    size_t getFrameCount() const;
+    size_t getPosition() const;
+};
+
+InputRecorder::InputRecorder() {
+    m_frames = 0;
+}
+
+bool InputRecorder::open(const std::string& path) {
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "Error creating input recording " << path << "\n";
+        return false;
+    }
+
+    InputRecordingHeader header {{'M', 'C', '2', 'I'}, INPUT_RECORDING_VERSION};
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_frames = 0;
+    return true;
+}
+
+bool InputRecorder::isOpen() const {
+    return m_file.is_open();
+}
+
+void InputRecorder::record(const InputFrame& frame) {
+    m_file.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    m_frames++;
+}
+
+void InputRecorder::close() {
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+size_t InputRecorder::getFrameCount() const {
+    return m_frames;
+}
+
+InputReplay::InputReplay() {
+    m_next = 0;
+}
+
+bool InputReplay::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    InputRecordingHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, "MC2I", 4) != 0 || header.version != INPUT_RECORDING_VERSION) {
+        std::cerr << "Invalid input recording " << path << "\n";
+        return false;
+    }
+
+    m_frames.clear();
+    InputFrame frame;
+    while (file.read(reinterpret_cast<char*>(&frame), sizeof(frame))) {
+        m_frames.push_back(frame);
+    }
+    m_next = 0;
+    return true;
+}
+
+bool InputReplay::isLoaded() const {
+    return !m_frames.empty();
+}
+
+bool InputReplay::next(InputFrame& frame) {
+    if (m_next >= m_frames.size()) {
+        return false;
+    }
+    frame = m_frames[m_next++];
+    return true;
+}
+
+size_t InputReplay::getFrameCount() const {
+    return m_frames.size();
+}
+
+size_t InputReplay::getPosition() const {
+    return m_next;
+}
+
+#endif
@@ -3,9 +3,15 @@
 
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
 #include "chunk.hpp"
 #include "gamedata.hpp"
-#include <unordered_map>
+#include "chunkMap.hpp"
 #include <tuple>
 
 // world loader namespace
@@ -13,99 +19,211 @@ namespace wl {
 
 using ChunkKey = std::tuple<int, int, int>;
 
-// Structs needed for position hashing functions
+// Every record of the world file is a header followed by size bytes of chunk data
 struct ChunkHeader {
     int x, y, z;
     uint32_t size; 
 };
 
-// Chunk hashing function
-struct KeyHash {
-    std::size_t operator()(const ChunkKey& k) const {
-        auto [x,y,z] = k;
-        return std::hash<long long>()(((long long)x<<40) ^ ((long long)y<<20) ^ (long long)z);
-    }
+// Set in the size of records whose chunk has been moved: their space can be reused
+const uint32_t FREE_RECORD = 0x80000000u;
+
+// Position of a chunk's record in the file, and the size of its data
+struct ChunkRecord {
+    std::streampos pos;
+    uint32_t size;
 };
 
-// Hash equals function
-struct KeyEq {
-    bool operator()(const ChunkKey& a, const ChunkKey& b) const {
-        return a == b;
+// Stores information about position of chunks in the file. Is loaded only on launch
+inline ChunkMap<ChunkRecord> chunkIndex;
+// Free records by data size, reused by chunks of the same size
+inline std::multimap<uint32_t, std::streampos> freeRecords;
+// Bytes of the file used by chunks and by free records
+inline uint64_t usedBytes = 0;
+inline uint64_t freeBytes = 0;
+
+// Opens the world file for reading and writing, creating it if it doesn't exist
+inline bool openWorldFile(std::fstream &file, const std::string &path) {
+    if (!std::filesystem::exists(path)) {
+        std::ofstream create(path, std::ios::binary);
     }
+
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    return (bool)file;
+}
+
+// Generator version a world was created with, stored in a file next to the world file
+struct GeneratorVersionHeader {
+    char magic[4];
+    uint32_t version;
 };
 
-// Stores information about position of chunks in the file. Is loaded only on launch
-inline std::unordered_map<std::tuple<int, int, int>, std::streampos, KeyHash, KeyEq> chunkIndex;
+// Called on launch, after openWorldFile: sets the generator to the version that created the
+// world, so that new chunks match the ones already in the file. New worlds record the current
+// version, worlds from before versions were recorded are version 1. Returns false on failure
+inline bool loadGeneratorVersion(WorldGenerator &generator, const std::string &path) {
+    std::string versionPath = path + ".gen";
+    GeneratorVersionHeader header;
+
+    if (std::filesystem::exists(versionPath)) {
+        std::ifstream in(versionPath, std::ios::binary);
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || memcmp(header.magic, "MC2G", 4) != 0) {
+            std::cerr << "Error: invalid generator version file " << versionPath << "\n";
+            return false;
+        }
+    } else {
+        std::error_code error;
+        bool newWorld = std::filesystem::file_size(path, error) == 0 && !error;
+        header = {{'M', 'C', '2', 'G'}, newWorld ? WORLD_GENERATOR_VERSION : 1u};
+
+        std::ofstream out(versionPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!out) {
+            std::cerr << "Error writing generator version file " << versionPath << "\n";
+            return false;
+        }
+    }
 
-// Reads chunks from a file and loads them to activechunks
-inline void loadActiveChunks(Player &player, WorldGenerator &generator, std::fstream &file, 
-    Chunk* activeChunks) {
-    
-    // Determines the position of the lower left corner chunk to be loaded
-    int tx = floor(player.getChunkPosition().x - RENDER_DISTANCE);
-    int ty = floor(player.getChunkPosition().y - RENDER_DISTANCE);
-    int tz = floor(player.getChunkPosition().z - RENDER_DISTANCE);
-
-    // Cicles in the active chunks
-    int limit = 2*RENDER_DISTANCE + 1;
-    for (int i = 0; i < limit; i++) {
-        for (int j = 0; j < limit; j++) {
-            for (int k = 0; k < limit; k++) {
-                int x = tx + i;
-                int y = ty + j;
-                int z = tz + k;
-
-                ChunkKey key = {x,y,z};
-
-                if (chunkIndex.find(key) != chunkIndex.end()) {
-                    // If the key is in the file, loads the chunk
-                    // Moves to the key's position in the file
-                    file.clear();
-                    file.seekg(chunkIndex[key]);
-
-                    // Reads the chunk's header
-                    ChunkHeader header;
-                    file.read(reinterpret_cast<char*>(&header), sizeof(header));
-
-                    // Reads the chunk's data
-                    BlockGrid data;
-                    file.read(reinterpret_cast<char*>(&data), header.size);
-
-                    // Adds the loaded chunk to activeChunks
-                    activeChunks[IDX(i, j, k)] = Chunk(glm::ivec3(x, y, z), data);
-                } else {
-                    // If the key is not in the file, creates the chunk
-                    BlockGrid data = generator.genChunk(x,y,z);
-                    activeChunks[IDX(i, j, k)] = Chunk(glm::ivec3(x, y, z), data);
-
-                    // Adds the chunk to the end of the file
-                    file.clear();
-                    file.seekp(0, std::ios::end);
-
-                    uint32_t size = sizeof(data);
-                    ChunkHeader header {x,y,z,size};
-                    std::streampos pos = file.tellp();
-
-                    // Writes the chunk header
-                    file.write(reinterpret_cast<char*>(&header), sizeof(header));
-                    
-                    // Writes the chunk data
-                    file.write(reinterpret_cast<char*>(&data), size);
-
-                    // Updates the index
-                    chunkIndex[key] = pos;
-                }
-            }
+    if (header.version > WORLD_GENERATOR_VERSION) {
+        std::cerr << "Warning: world created by a newer generator (version " << header.version
+            << "), new chunks are generated with version " << WORLD_GENERATOR_VERSION << "\n";
+        generator.setVersion(WORLD_GENERATOR_VERSION);
+    } else {
+        if (header.version < WORLD_GENERATOR_VERSION) {
+            std::cout << "World created by generator version " << header.version
+                << ": new chunks are generated the same way\n";
         }
+        generator.setVersion(header.version);
+    }
+    return true;
+}
+
+// Marks a record as free and remembers it for reuse
+inline void freeRecord(std::fstream &file, std::streampos pos, uint32_t size) {
+    file.clear();
+    file.seekg(pos);
+    ChunkHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    header.size = size | FREE_RECORD;
+    file.clear();
+    file.seekp(pos);
+    file.write(reinterpret_cast<char*>(&header), sizeof(header));
+
+    freeRecords.emplace(size, pos);
+    usedBytes -= sizeof(ChunkHeader) + size;
+    freeBytes += sizeof(ChunkHeader) + size;
+}
+
+// Writes a chunk and updates the index. A chunk already in the file is overwritten in place;
+// new chunks reuse a free record of the same size, or are appended to the end of the file
+inline void writeChunk(std::fstream &file, int x, int y, int z, const BlockGrid &data) {
+    uint32_t size = sizeof(data);
+    ChunkRecord* record = chunkIndex.find(x, y, z);
+
+    // Same size: only the data is rewritten
+    if (record != nullptr && record->size == size) {
+        file.clear();
+        file.seekp(record->pos + (std::streamoff)sizeof(ChunkHeader));
+        file.write(reinterpret_cast<const char*>(&data), size);
+        return;
+    }
+
+    if (record != nullptr) {
+        freeRecord(file, record->pos, record->size);
+    }
+
+    file.clear();
+    std::streampos pos;
+    auto reused = freeRecords.find(size);
+    if (reused != freeRecords.end()) {
+        pos = reused->second;
+        freeRecords.erase(reused);
+        freeBytes -= sizeof(ChunkHeader) + size;
+        file.seekp(pos);
+    } else {
+        file.seekp(0, std::ios::end);
+        pos = file.tellp();
+    }
+
+    // Writes the chunk header
+    ChunkHeader header {x,y,z,size};
+    file.write(reinterpret_cast<char*>(&header), sizeof(header));
+    
+    // Writes the chunk data
+    file.write(reinterpret_cast<const char*>(&data), size);
+
+    // Updates the index
+    chunkIndex(x, y, z) = {pos, size};
+    usedBytes += sizeof(ChunkHeader) + size;
+}
+
+// Saves a modified chunk to the file
+inline void saveChunk(std::fstream &file, const Chunk &chunk) {
+    glm::ivec3 pos = chunk.getChunkPos();
+    writeChunk(file, pos.x, pos.y, pos.z, chunk.getBlockGrid());
+}
+
+// Integer division rounding towards negative infinity
+inline int floorDiv(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Returns the position of the chunk containing a block
+inline glm::ivec3 blockToChunk(glm::ivec3 blockPos) {
+    return glm::ivec3(floorDiv(blockPos.x, CHUNCK_SIZE), floorDiv(blockPos.y, CHUNCK_SIZE), 
+        floorDiv(blockPos.z, CHUNCK_SIZE));
+}
+
+// Reads a chunk's blocks from the file. Returns false if the chunk has never been generated
+inline bool readChunkData(std::fstream &file, int x, int y, int z, BlockGrid &data) {
+    const ChunkRecord* record = chunkIndex.find(x, y, z);
+    if (record == nullptr) {
+        return false;
+    }
+
+    // Moves to the key's position in the file
+    file.clear();
+    file.seekg(record->pos);
+
+    // Reads the chunk's header
+    ChunkHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    // Reads the chunk's data
+    file.read(reinterpret_cast<char*>(&data), header.size);
+    return true;
+}
+
+// Reads a chunk's blocks from the file, or generates them and adds them to the file
+// if the chunk has never been generated
+inline BlockGrid loadChunkData(WorldGenerator &generator, std::fstream &file, int x, int y, int z) {
+    BlockGrid data;
+    if (!readChunkData(file, x, y, z, data)) {
+        // If the key is not in the file, creates the chunk
+        data = generator.genChunk(x,y,z);
+
+        // Adds the chunk to the end of the file
+        writeChunk(file, x, y, z, data);
     }
+    return data;
 }
 
-// Called on launch: Loads the chunk index
+// Called on launch: Loads the chunk index and the free records
 inline void buildChunkIndex(std::fstream &file) {
     #ifdef DEBUG
     std::cout << "Loading world index...\n";
     int n = 0;
     #endif
+
+    chunkIndex.clear();
+    freeRecords.clear();
+    usedBytes = 0;
+    freeBytes = 0;
+
+    // Older copies of chunks, left by files written before records were overwritten in place
+    std::vector<ChunkRecord> stale;
     
     // Resets file stream
     file.clear();
@@ -122,54 +240,89 @@ inline void buildChunkIndex(std::fstream &file) {
         // stops if the end of the file has been reached
         if (!file) {
             #ifdef DEBUG
-            std::cout << "Loaded world index: " << n << " chunks loaded successfully\n";
+            std::cout << "Loaded world index: " << n << " chunks loaded successfully, "
+                << freeBytes/1024 << " KB free\n";
             #endif
 
             break;
         }
 
         // Skips to next chunk
-        file.seekg(header.size, std::ios::cur);
+        uint32_t size = header.size & ~FREE_RECORD;
+        file.seekg(size, std::ios::cur);
 
-        // Saves the current chunk in the index
-        chunkIndex[{header.x, header.y, header.z}] = pos;
-        n++;
+        if (header.size & FREE_RECORD) {
+            freeRecords.emplace(size, pos);
+            freeBytes += sizeof(ChunkHeader) + size;
+            continue;
+        }
+
+        // Saves the current chunk in the index. The last copy of a chunk is the current one
+        auto [record, inserted] = chunkIndex.tryEmplace(header.x, header.y, header.z);
+        if (!inserted) {
+            stale.push_back(*record);
+        }
+        *record = {pos, size};
+        usedBytes += sizeof(ChunkHeader) + size;
+
+        #ifdef DEBUG
+        n += inserted ? 1 : 0;
+        #endif
+    }
+
+    for (const ChunkRecord& record : stale) {
+        freeRecord(file, record.pos, record.size);
     }
 }
 
-// Loads data from active chunks into vertices data
-inline void loadActiveVertices(Player& player, std::vector<float>& vertices, std::vector<unsigned int>& indices, 
-    const Chunk* activeChunks) {
-    
-    // Makes sure vectors are empty
-    vertices.clear();
-    indices.clear();
-
-    // Cicles into active chunks
-    for (int i = -RENDER_DISTANCE; i <= RENDER_DISTANCE; i++) {
-    for (int j = -RENDER_DISTANCE; j <= RENDER_DISTANCE; j++) {
-    for (int k = -RENDER_DISTANCE; k <= RENDER_DISTANCE; k++) {
-        // Current active chunk
-        const Chunk* activeChunk = &(activeChunks[IDX(i + RENDER_DISTANCE, j + RENDER_DISTANCE, k + RENDER_DISTANCE)]);
-
-        // Position of active chunk relative to player
-        glm::ivec3 relChunkPos = glm::ivec3(i, j, k)*(CHUNCK_SIZE);
-
-        // translate chunks vertices
-        std::vector<float> translatedVertices = activeChunk->translateVertices(relChunkPos);
-
-        // Calculates how much to translate indices
-        int toTranslate = vertices.size() / 3;
-
-        // Loads vertices
-        vertices.insert(vertices.end(), translatedVertices.begin(), translatedVertices.end());
-
-        // translates indices
-        std::vector<unsigned int> translatedIndices = activeChunk->translateIndices(toTranslate);
-        
-        // Loads indices
-        indices.insert(indices.end(), translatedIndices.begin(), translatedIndices.end());
-    }}}
+// True if most of the file is free space
+inline bool isFragmented() {
+    return freeBytes > usedBytes;
+}
+
+// Rewrites the file with only its chunks, in Morton order so that neighbouring chunks are
+// next to each other on disk. The file is reopened and the index rebuilt. Returns false on failure
+inline bool compactWorld(std::fstream &file, const std::string &path) {
+    uint64_t oldSize = usedBytes + freeBytes;
+
+    // Chunks sorted by Morton code
+    std::vector<std::pair<uint64_t, ChunkRecord>> records;
+    chunkIndex.forEach([&](int x, int y, int z, ChunkRecord& record) {
+        records.push_back({ChunkMap<ChunkRecord>::encode(x, y, z), record});
+    });
+    std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    // Writes a new file next to the old one, so a failure leaves the world untouched
+    std::string compactPath = path + ".compact";
+    std::ofstream out(compactPath, std::ios::binary | std::ios::trunc);
+    std::vector<char> buffer;
+    for (const auto& [key, record] : records) {
+        buffer.resize(sizeof(ChunkHeader) + record.size);
+        file.clear();
+        file.seekg(record.pos);
+        file.read(buffer.data(), buffer.size());
+        out.write(buffer.data(), buffer.size());
+    }
+    out.close();
+
+    if (!file || !out) {
+        std::cerr << "Error compacting world file\n";
+        std::filesystem::remove(compactPath);
+        return false;
+    }
+
+    file.close();
+    std::filesystem::rename(compactPath, path);
+    if (!openWorldFile(file, path)) {
+        std::cerr << "Error loading world file\n";
+        return false;
+    }
+    buildChunkIndex(file);
+
+    std::cout << "Compacted world file: " << oldSize/1024 << " KB -> " << usedBytes/1024 << " KB\n";
+    return true;
 }
 
 }
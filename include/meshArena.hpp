@@ -0,0 +1,289 @@
+#ifndef MESH_ARENA
+#define MESH_ARENA
+
+#include <glad/glad.h>
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <vector>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "chunkWindow.hpp"
+#include "quadIndexBuffer.hpp"
+#include "stagingRing.hpp"
+
+// Vertices per page of the arena
+#define MESH_PAGE_VERTICES (4*MESH_PAGE_QUADS)
+
+// Pages of the arena holding a chunk's mesh
+struct MeshSlot {
+    size_t page;
+    size_t pageCount;
+    unsigned int quadCount;
+};
+
+// Vertex buffer allocated once, holding the mesh of every chunk in its own slot. A chunk
+// whose mesh changes is uploaded alone, the other meshes are left untouched.
+// Meshes stay in chunk space: the arena is split in pages and a page table (a buffer
+// texture) gives the chunk position of each page, which the vertex shader turns into
+// an offset from the camera's chunk
+class MeshArena
+{
+private:
+    GLuint m_VBO;
+    size_t m_pageCount;
+    size_t m_usedPages;
+    // Size of the last buffer the GPU couldn't allocate, 0 if none. Larger ones aren't tried
+    size_t m_failedPageCount;
+
+    // Chunk position of every page, on the CPU and in a buffer texture
+    std::vector<glm::ivec4> m_pageChunks;
+    GLuint m_pageBuffer;
+    GLuint m_pageTexture;
+
+    // Free pages: first page -> number of pages
+    std::map<size_t, size_t> m_free;
+    ChunkMap<MeshSlot> m_slots;
+
+    // Finds room for count pages. Returns false if the arena is full
+    bool allocate(size_t count, size_t& page);
+    void deallocate(size_t page, size_t count);
+    // Moves the meshes to a buffer of pageCount pages. The buffer changes: VAOs using it
+    // have to be set up again. Returns false if the GPU is out of memory, the arena is unchanged
+    bool grow(size_t pageCount);
+
+public:
+    MeshArena();
+    virtual ~MeshArena() = default;
+
+    // Creates a buffer of size bytes. The arena grows when a larger window needs more
+    void create(size_t size);
+    GLuint getBuffer() const;
+    // Binds the page table to a texture unit, for the shader's isamplerBuffer
+    void bindPageTable(int unit) const;
+
+    // Uploads a chunk's mesh through the staging ring. Returns false if the ring's budget
+    // for this frame is used up, or if the GPU has no memory left for the arena to grow:
+    // the upload has to be retried later
+    bool upload(const Chunk& chunk, StagingRing& ring);
+    // Frees the slot of a chunk
+    void release(glm::ivec3 chunkPos);
+
+    // Adds a draw for every loaded chunk of the window that has a mesh in the arena
+    void buildDrawList(const ChunkWindow& window, ChunkDrawList& draws) const;
+
+    size_t getUsedBytes() const;
+    void Delete();
+};
+
+MeshArena::MeshArena() {
+    m_VBO = 0;
+    m_pageCount = 0;
+    m_usedPages = 0;
+    m_failedPageCount = 0;
+    m_pageBuffer = 0;
+    m_pageTexture = 0;
+}
+
+bool MeshArena::grow(size_t pageCount) {
+    size_t pageBytes = MESH_PAGE_VERTICES*VERTEX_SIZE*sizeof(float);
+    if (m_failedPageCount != 0 && pageCount >= m_failedPageCount) {
+        return false;
+    }
+
+    // The GPU copies the meshes, they never go back to the CPU
+    GLuint newVBO;
+    glGenBuffers(1, &newVBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, pageCount*pageBytes, nullptr, GL_STATIC_DRAW);
+
+    // The buffer has no storage if the GPU is out of memory
+    GLint64 allocated = 0;
+    glGetBufferParameteri64v(GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &allocated);
+    if ((size_t)allocated != pageCount*pageBytes) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &newVBO);
+        m_failedPageCount = pageCount;
+        std::cerr << "Error: no GPU memory to grow the chunk mesh arena to " << pageCount*pageBytes/(1024*1024) << " MB\n";
+        return false;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, m_VBO);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_pageCount*pageBytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &m_VBO);
+    m_VBO = newVBO;
+
+    // New pages are added as used then freed, which merges them with the free pages at the end
+    m_usedPages += pageCount - m_pageCount;
+    deallocate(m_pageCount, pageCount - m_pageCount);
+
+    m_pageChunks.resize(pageCount, glm::ivec4(0, 0, 0, 0));
+    glBindBuffer(GL_TEXTURE_BUFFER, m_pageBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, pageCount*sizeof(glm::ivec4), m_pageChunks.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_pageTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, m_pageBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    #ifdef DEBUG
+    std::cout << "Mesh arena grown to " << pageCount*pageBytes/(1024*1024) << " MB\n";
+    #endif
+
+    m_pageCount = pageCount;
+    return true;
+}
+
+void MeshArena::create(size_t size) {
+    m_pageCount = size / (MESH_PAGE_VERTICES*VERTEX_SIZE*sizeof(float));
+    m_free.clear();
+    m_free[0] = m_pageCount;
+
+    glGenBuffers(1, &m_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, m_pageCount*MESH_PAGE_VERTICES*VERTEX_SIZE*sizeof(float), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // One ivec4 per page: the chunk position, w is unused
+    m_pageChunks.assign(m_pageCount, glm::ivec4(0, 0, 0, 0));
+    glGenBuffers(1, &m_pageBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_pageBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_pageCount*sizeof(glm::ivec4), m_pageChunks.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &m_pageTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_pageTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, m_pageBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+GLuint MeshArena::getBuffer() const {
+    return m_VBO;
+}
+
+void MeshArena::bindPageTable(int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_pageTexture);
+}
+
+bool MeshArena::allocate(size_t count, size_t& page) {
+    // First fit
+    for (auto it = m_free.begin(); it != m_free.end(); it++) {
+        if (it->second < count) {
+            continue;
+        }
+
+        page = it->first;
+        size_t left = it->second - count;
+        m_free.erase(it);
+        if (left > 0) {
+            m_free[page + count] = left;
+        }
+
+        m_usedPages += count;
+        return true;
+    }
+    return false;
+}
+
+void MeshArena::deallocate(size_t page, size_t count) {
+    m_usedPages -= count;
+    auto it = m_free.emplace(page, count).first;
+
+    // Merges with the free pages right after and right before
+    auto next = std::next(it);
+    if (next != m_free.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        m_free.erase(next);
+    }
+    if (it != m_free.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            m_free.erase(it);
+        }
+    }
+}
+
+bool MeshArena::upload(const Chunk& chunk, StagingRing& ring) {
+    glm::ivec3 pos = chunk.getChunkPos();
+    const std::vector<float>& vertices = chunk.getChunkVertices();
+    unsigned int quadCount = chunk.getQuadCount();
+
+    if (sizeof(float)*vertices.size() > ring.getFrameRemaining()) {
+        return false;
+    }
+
+    // Empty chunks don't need a slot
+    if (quadCount == 0) {
+        release(pos);
+        return true;
+    }
+
+    // Slots are reused while the mesh fits, so blocks changing rarely move a chunk
+    size_t pageCount = (4*quadCount + MESH_PAGE_VERTICES - 1) / MESH_PAGE_VERTICES;
+    MeshSlot* slot = m_slots.find(pos.x, pos.y, pos.z);
+    if (slot == nullptr || slot->pageCount < pageCount) {
+        release(pos);
+
+        // A full arena doubles, so a larger window doesn't need a reload. If it can't, the
+        // chunk stays queued until meshes of chunks leaving the window free their pages
+        size_t page;
+        if (!allocate(pageCount, page)) {
+            if (!grow(std::max(2*m_pageCount, m_pageCount + pageCount)) || !allocate(pageCount, page)) {
+                return false;
+            }
+        }
+
+        slot = &m_slots(pos.x, pos.y, pos.z);
+        slot->page = page;
+        slot->pageCount = pageCount;
+
+        // Points the new pages to the chunk
+        for (size_t i = page; i < page + pageCount; i++) {
+            m_pageChunks[i] = glm::ivec4(pos, 0);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, m_pageBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, page*sizeof(glm::ivec4), pageCount*sizeof(glm::ivec4), &m_pageChunks[page]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+    slot->quadCount = quadCount;
+
+    return ring.upload(m_VBO, slot->page*MESH_PAGE_VERTICES*VERTEX_SIZE*sizeof(float), vertices.data(), sizeof(float)*vertices.size());
+}
+
+void MeshArena::release(glm::ivec3 chunkPos) {
+    MeshSlot* slot = m_slots.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (slot == nullptr) {
+        return;
+    }
+
+    deallocate(slot->page, slot->pageCount);
+    m_slots.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+}
+
+void MeshArena::buildDrawList(const ChunkWindow& window, ChunkDrawList& draws) const {
+    draws.clear();
+
+    window.forEachLoaded([&](const Chunk& chunk) {
+        glm::ivec3 pos = chunk.getChunkPos();
+        const MeshSlot* slot = m_slots.find(pos.x, pos.y, pos.z);
+        if (slot != nullptr) {
+            draws.add(slot->page*MESH_PAGE_VERTICES, slot->quadCount);
+        }
+    });
+}
+
+size_t MeshArena::getUsedBytes() const {
+    return m_usedPages*MESH_PAGE_VERTICES*VERTEX_SIZE*sizeof(float);
+}
+
+void MeshArena::Delete() {
+    glDeleteBuffers(1, &m_VBO);
+    glDeleteTextures(1, &m_pageTexture);
+    glDeleteBuffers(1, &m_pageBuffer);
+}
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef MESH_CACHE
+#define MESH_CACHE
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+
+// Header of the mesh cache file
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t chunkSize;
+};
+
+// Every record is this header followed by floatCount floats of mesh
+struct MeshRecordHeader {
+    int32_t x, y, z;
+    uint32_t floatCount;
+    uint64_t blockHash;
+    uint32_t hasGravityBlocks;
+    uint32_t padding;
+};
+
+// Where the last record of a chunk is in the file
+struct MeshCacheEntry {
+    uint64_t offset;
+    uint64_t blockHash;
+    uint32_t floatCount;
+    bool hasGravityBlocks;
+};
+
+// Meshes of chunks kept on disk between sessions, keyed by chunk position and a hash of the
+// chunk's blocks. The file is mapped in memory: a hit copies the mesh straight out of the
+// page cache instead of meshing the chunk again. New meshes are appended, a chunk whose blocks
+// changed gets a new record and its old one becomes garbage until the file is compacted
+class MeshCache
+{
+private:
+    std::string m_path;
+    int m_fd;
+    const char* m_map;
+    size_t m_mapSize;
+    // Records are appended through m_out. Records written after the file was mapped are
+    // mapped again when they are needed
+    std::ofstream m_out;
+    size_t m_fileSize;
+
+    ChunkMap<MeshCacheEntry> m_index;
+    // Bytes of the records in the index
+    size_t m_liveBytes;
+
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_stored;
+
+    // Maps the whole file
+    bool map();
+    void unmap();
+    // Reads the records of the mapped file into the index. Returns the size of the valid
+    // part of the file: a record cut short by a crash is dropped
+    size_t readIndex();
+    // Rewrites the file with only the records in the index
+    bool compact();
+
+public:
+    MeshCache();
+    virtual ~MeshCache();
+
+    // Opens the cache file, creating it or starting over if it was written by another mesher
+    bool open(const std::string& path);
+    bool isOpen() const;
+    void close();
+
+    // Gives the chunk its cached mesh. Returns false if it's not cached or its blocks changed
+    bool load(Chunk& chunk);
+    // Adds the mesh of a meshed chunk
+    void store(const Chunk& chunk);
+
+    size_t size() const;
+    size_t getHits() const;
+    size_t getMisses() const;
+    size_t getStored() const;
+};
+
+MeshCache::MeshCache() {
+    m_fd = -1;
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_fileSize = 0;
+    m_liveBytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_stored = 0;
+}
+
+MeshCache::~MeshCache() {
+    close();
+}
+
+bool MeshCache::open(const std::string& path) {
+    close();
+    m_path = path;
+
+    // Starts a new file if it's missing or was written with another mesher or vertex format
+    MeshCacheHeader expected {{'M', 'C', '2', 'M'}, MESHER_VERSION, VERTEX_SIZE, CHUNCK_SIZE};
+    MeshCacheHeader header;
+    std::ifstream in(path, std::ios::binary);
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || memcmp(&header, &expected, sizeof(header)) != 0) {
+        in.close();
+        std::ofstream create(path, std::ios::binary | std::ios::trunc);
+        create.write(reinterpret_cast<const char*>(&expected), sizeof(expected));
+        if (!create) {
+            std::cerr << "Error creating mesh cache\n";
+            return false;
+        }
+    }
+    in.close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0 || !map()) {
+        std::cerr << "Error opening mesh cache\n";
+        close();
+        return false;
+    }
+
+    size_t validSize = readIndex();
+    if (validSize < m_mapSize) {
+        unmap();
+        std::filesystem::resize_file(path, validSize);
+        if (!map()) {
+            std::cerr << "Error opening mesh cache\n";
+            close();
+            return false;
+        }
+    }
+
+    // Mostly old meshes of chunks that changed
+    if (m_mapSize > 2*(m_liveBytes + sizeof(MeshCacheHeader)) && !compact()) {
+        close();
+        return false;
+    }
+
+    m_fileSize = m_mapSize;
+    m_out.open(path, std::ios::binary | std::ios::app);
+
+    #ifdef DEBUG
+    std::cout << "Mesh cache: " << m_index.size() << " meshes, " << m_fileSize/1024 << " KB\n";
+    #endif
+
+    return (bool)m_out;
+}
+
+bool MeshCache::isOpen() const {
+    return m_fd >= 0;
+}
+
+void MeshCache::close() {
+    if (m_out.is_open()) {
+        m_out.close();
+    }
+    unmap();
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_index.clear();
+    m_liveBytes = 0;
+}
+
+bool MeshCache::map() {
+    struct stat info;
+    if (fstat(m_fd, &info) != 0) {
+        return false;
+    }
+
+    m_mapSize = info.st_size;
+    void* data = mmap(nullptr, m_mapSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED) {
+        m_mapSize = 0;
+        return false;
+    }
+
+    m_map = static_cast<const char*>(data);
+    return true;
+}
+
+void MeshCache::unmap() {
+    if (m_map != nullptr) {
+        munmap(const_cast<char*>(m_map), m_mapSize);
+        m_map = nullptr;
+    }
+    m_mapSize = 0;
+}
+
+size_t MeshCache::readIndex() {
+    m_index.clear();
+    m_liveBytes = 0;
+
+    size_t offset = sizeof(MeshCacheHeader);
+    while (offset + sizeof(MeshRecordHeader) <= m_mapSize) {
+        MeshRecordHeader record;
+        memcpy(&record, m_map + offset, sizeof(record));
+        size_t size = sizeof(record) + (size_t)record.floatCount*sizeof(float);
+        if (offset + size > m_mapSize) {
+            break;
+        }
+
+        // The last record of a chunk is the current one
+        auto [entry, inserted] = m_index.tryEmplace(record.x, record.y, record.z);
+        if (!inserted) {
+            m_liveBytes -= sizeof(MeshRecordHeader) + (size_t)entry->floatCount*sizeof(float);
+        }
+        *entry = {offset, record.blockHash, record.floatCount, record.hasGravityBlocks != 0};
+        m_liveBytes += size;
+        offset += size;
+    }
+    return offset;
+}
+
+bool MeshCache::compact() {
+    std::string compactPath = m_path + ".compact";
+    std::ofstream out(compactPath, std::ios::binary | std::ios::trunc);
+    out.write(m_map, sizeof(MeshCacheHeader));
+    m_index.forEach([&](int, int, int, MeshCacheEntry& entry) {
+        out.write(m_map + entry.offset, sizeof(MeshRecordHeader) + (size_t)entry.floatCount*sizeof(float));
+    });
+    out.close();
+
+    if (!out) {
+        std::cerr << "Error compacting mesh cache\n";
+        std::filesystem::remove(compactPath);
+        return false;
+    }
+
+    #ifdef DEBUG
+    std::cout << "Compacted mesh cache from " << m_mapSize/1024 << " KB to "
+        << (m_liveBytes + sizeof(MeshCacheHeader))/1024 << " KB\n";
+    #endif
+
+    unmap();
+    ::close(m_fd);
+    std::filesystem::rename(compactPath, m_path);
+
+    m_fd = ::open(m_path.c_str(), O_RDONLY);
+    if (m_fd < 0 || !map()) {
+        std::cerr << "Error opening mesh cache\n";
+        return false;
+    }
+    readIndex();
+    return true;
+}
+
+bool MeshCache::load(Chunk& chunk) {
+    glm::ivec3 pos = chunk.getChunkPos();
+    const MeshCacheEntry* entry = m_index.find(pos.x, pos.y, pos.z);
+    if (entry == nullptr || entry->blockHash != chunk.hashBlocks()) {
+        m_misses++;
+        return false;
+    }
+
+    // Written this session, after the file was mapped
+    size_t end = entry->offset + sizeof(MeshRecordHeader) + (size_t)entry->floatCount*sizeof(float);
+    if (end > m_mapSize) {
+        m_out.flush();
+        unmap();
+        if (!map() || end > m_mapSize) {
+            m_misses++;
+            return false;
+        }
+    }
+
+    // Records are 4 byte aligned, the floats can be read in place
+    const float* vertices = reinterpret_cast<const float*>(m_map + entry->offset + sizeof(MeshRecordHeader));
+    chunk.setMesh(vertices, entry->floatCount, entry->hasGravityBlocks);
+    m_hits++;
+    return true;
+}
+
+void MeshCache::store(const Chunk& chunk) {
+    if (!m_out.is_open() || !chunk.isMeshed()) {
+        return;
+    }
+
+    glm::ivec3 pos = chunk.getChunkPos();
+    uint64_t hash = chunk.hashBlocks();
+    auto [entry, inserted] = m_index.tryEmplace(pos.x, pos.y, pos.z);
+    if (!inserted && entry->blockHash == hash) {
+        return;
+    }
+
+    const std::vector<float>& vertices = chunk.getChunkVertices();
+    MeshRecordHeader record {pos.x, pos.y, pos.z, (uint32_t)vertices.size(), hash, chunk.hasGravityBlocks(), 0};
+    m_out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    m_out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size()*sizeof(float));
+
+    size_t size = sizeof(record) + vertices.size()*sizeof(float);
+    if (!inserted) {
+        m_liveBytes -= sizeof(MeshRecordHeader) + (size_t)entry->floatCount*sizeof(float);
+    }
+    *entry = {m_fileSize, hash, (uint32_t)vertices.size(), chunk.hasGravityBlocks()};
+    m_liveBytes += size;
+    m_fileSize += size;
+    m_stored++;
+}
+
+size_t MeshCache::size() const {
+    return m_index.size();
+}
+
+size_t MeshCache::getHits() const {
+    return m_hits;
+}
+
+size_t MeshCache::getMisses() const {
+    return m_misses;
+}
+
+size_t MeshCache::getStored() const {
+    return m_stored;
+}
+
+#endif
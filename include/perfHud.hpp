@@ -0,0 +1,291 @@
+#ifndef PERF_HUD
+#define PERF_HUD
+
+#include <glad/glad.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <shaders/shaders.h>
+#include "gamedata.hpp"
+
+// Frames shown in the frame time graph
+#define HUD_GRAPH_FRAMES 120
+// Size in pixels of a font pixel
+#define HUD_TEXT_SCALE 2
+
+// 3x5 bitmap font: 5 rows of 3 pixels per glyph, top row first.
+// Lower case letters are drawn in upper case, missing glyphs are blank
+struct HudGlyph {
+    char c;
+    const char* rows;
+};
+
+inline const HudGlyph hudFont[] = {
+    {'0', "111101101101111"}, {'1', "010110010010111"}, {'2', "111001111100111"},
+    {'3', "111001111001111"}, {'4', "101101111001001"}, {'5', "111100111001111"},
+    {'6', "111100111101111"}, {'7', "111001001001001"}, {'8', "111101111101111"},
+    {'9', "111101111001111"},
+    {'A', "010101111101101"}, {'B', "110101110101110"}, {'C', "011100100100011"},
+    {'D', "110101101101110"}, {'E', "111100110100111"}, {'F', "111100110100100"},
+    {'G', "011100101101011"}, {'H', "101101111101101"}, {'I', "111010010010111"},
+    {'J', "001001001101010"}, {'K', "101101110101101"}, {'L', "100100100100111"},
+    {'M', "101111111101101"}, {'N', "110101101101101"}, {'O', "010101101101010"},
+    {'P', "110101110100100"}, {'Q', "010101101110011"}, {'R', "110101110101101"},
+    {'S', "011100010001110"}, {'T', "111010010010010"}, {'U', "101101101101111"},
+    {'V', "101101101101010"}, {'W', "101101111111101"}, {'X', "101101010101101"},
+    {'Y', "101101010010010"}, {'Z', "111001010100111"},
+    {'.', "000000000000010"}, {',', "000000000010100"}, {':', "000010000010000"},
+    {'/', "001001010100100"}, {'%', "101001010100101"}, {'-', "000000111000000"},
+    {'+', "000010111010000"}, {'=', "000111000111000"}, {'(', "010100100100010"},
+    {')', "010001001001010"}, {'_', "000000000000111"}
+};
+
+// Numbers shown by the HUD, gathered by the main loop every frame
+struct PerfStats {
+    // Whole frame, and time spent working on it on the CPU
+    double frameMs;
+    double cpuMs;
+    // GPU time of uploads and draws, if the driver has timer queries
+    bool hasGpuTimes;
+    double gpuUploadMs;
+    double gpuDrawMs;
+    // Frame time the render distance adapts to, 0 if it's fixed
+    double targetMs;
+
+    size_t triangles;
+    int renderDistance;
+    size_t chunksLoaded;
+    size_t chunksPending;
+    size_t uploadsPending;
+    size_t uploadBytes;
+
+    size_t meshBytes;
+    size_t chunkBytes;
+    size_t cacheBytes;
+};
+
+// Overlay with a frame time graph and live stats. Everything is drawn with a single draw
+// call of colored quads: glyphs sample a small font texture, other quads sample its solid texel
+class PerfHud
+{
+private:
+    GLuint m_VAO;
+    GLuint m_VBO;
+    GLuint m_fontTexture;
+    int m_fontWidth;
+    int m_fontHeight;
+
+    // Last frame times, oldest first
+    std::deque<float> m_frameTimes;
+    // x, y in pixels from the top left corner, u, v, r, g, b, a
+    std::vector<float> m_vertices;
+
+    void addQuad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const float color[4]);
+    void addRect(float x, float y, float w, float h, const float color[4]);
+    void addText(float x, float y, const std::string& text, const float color[4]);
+
+public:
+    PerfHud();
+    virtual ~PerfHud() = default;
+
+    // Creates the font texture and the buffers
+    void create();
+
+    // Adds a frame to the graph. Called every frame, even when the HUD is hidden
+    void record(double frameMs);
+    // Draws the HUD with the HUD shader, whose "font" sampler must use textureUnit
+    void draw(const PerfStats& stats, Shader& shader, int textureUnit);
+    void Delete();
+};
+
+PerfHud::PerfHud() {
+    m_VAO = 0;
+    m_VBO = 0;
+    m_fontTexture = 0;
+    m_fontWidth = 0;
+    m_fontHeight = 0;
+}
+
+void PerfHud::create() {
+    // One 3x5 cell per ASCII character from ' ' to '~', and a solid cell at the end
+    const int glyphs = 127 - 32;
+    m_fontWidth = 3*(glyphs + 1);
+    m_fontHeight = 5;
+    std::vector<unsigned char> texels(m_fontWidth*m_fontHeight, 0);
+
+    for (const HudGlyph& glyph : hudFont) {
+        int cell = glyph.c - 32;
+        for (int i = 0; i < 15; i++) {
+            texels[(i / 3)*m_fontWidth + 3*cell + i % 3] = glyph.rows[i] == '1' ? 255 : 0;
+        }
+    }
+    for (int y = 0; y < m_fontHeight; y++) {
+        for (int x = 0; x < 3; x++) {
+            texels[y*m_fontWidth + 3*glyphs + x] = 255;
+        }
+    }
+
+    glGenTextures(1, &m_fontTexture);
+    glBindTexture(GL_TEXTURE_2D, m_fontTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_fontWidth, m_fontHeight, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+
+    // Position, texture coordinates and color
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(2*sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(4*sizeof(float)));
+    glEnableVertexAttribArray(2);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PerfHud::record(double frameMs) {
+    m_frameTimes.push_back(frameMs);
+    if (m_frameTimes.size() > HUD_GRAPH_FRAMES) {
+        m_frameTimes.pop_front();
+    }
+}
+
+void PerfHud::addQuad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const float color[4]) {
+    const float corners[6][4] = {
+        {x, y, u0, v0}, {x + w, y, u1, v0}, {x + w, y + h, u1, v1},
+        {x, y, u0, v0}, {x + w, y + h, u1, v1}, {x, y + h, u0, v1}
+    };
+    for (const float* corner : corners) {
+        m_vertices.insert(m_vertices.end(), corner, corner + 4);
+        m_vertices.insert(m_vertices.end(), color, color + 4);
+    }
+}
+
+void PerfHud::addRect(float x, float y, float w, float h, const float color[4]) {
+    // Center of the solid cell
+    float u = (m_fontWidth - 1.5f) / m_fontWidth;
+    float v = 0.5f;
+    addQuad(x, y, w, h, u, v, u, v, color);
+}
+
+void PerfHud::addText(float x, float y, const std::string& text, const float color[4]) {
+    for (char c : text) {
+        int cell = toupper((unsigned char)c) - 32;
+        if (cell > 0 && cell < 127 - 32) {
+            float u0 = 3.0f*cell / m_fontWidth;
+            float u1 = 3.0f*(cell + 1) / m_fontWidth;
+            addQuad(x, y, 3*HUD_TEXT_SCALE, 5*HUD_TEXT_SCALE, u0, 0.0f, u1, 1.0f, color);
+        }
+        x += 4*HUD_TEXT_SCALE;
+    }
+}
+
+void PerfHud::draw(const PerfStats& stats, Shader& shader, int textureUnit) {
+    const float background[4] = {0.0f, 0.0f, 0.0f, 0.6f};
+    const float white[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    const float green[4] = {0.3f, 0.9f, 0.3f, 1.0f};
+    const float red[4] = {0.95f, 0.3f, 0.25f, 1.0f};
+    const float yellow[4] = {0.95f, 0.85f, 0.2f, 1.0f};
+
+    m_vertices.clear();
+
+    // Text lines
+    std::vector<std::string> lines;
+    char line[128];
+    snprintf(line, sizeof(line), "FRAME %.2f MS (%.0f FPS)", stats.frameMs, stats.frameMs > 0 ? 1000.0/stats.frameMs : 0.0);
+    lines.push_back(line);
+    if (stats.hasGpuTimes) {
+        snprintf(line, sizeof(line), "CPU %.2f MS  GPU %.2f MS (UPLOAD %.2f, DRAW %.2f)",
+            stats.cpuMs, stats.gpuUploadMs + stats.gpuDrawMs, stats.gpuUploadMs, stats.gpuDrawMs);
+    } else {
+        snprintf(line, sizeof(line), "CPU %.2f MS  GPU N/A", stats.cpuMs);
+    }
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "TRIANGLES %zu", stats.triangles);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "CHUNKS %zu LOADED, %zu PENDING, RADIUS %d", stats.chunksLoaded, stats.chunksPending, stats.renderDistance);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "UPLOAD %zu KB/FRAME, %zu MESHES QUEUED", stats.uploadBytes/1024, stats.uploadsPending);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "MEMORY: MESHES %zu MB, CHUNKS %zu MB, CACHE %zu MB",
+        stats.meshBytes/(1024*1024), stats.chunkBytes/(1024*1024), stats.cacheBytes/(1024*1024));
+    lines.push_back(line);
+
+    const float margin = 8.0f;
+    const float lineHeight = 7*HUD_TEXT_SCALE;
+    const float graphWidth = 2.0f*HUD_GRAPH_FRAMES;
+    const float graphHeight = 60.0f;
+
+    size_t longest = 0;
+    for (const std::string& text : lines) {
+        longest = std::max(longest, text.size());
+    }
+    float width = std::max(graphWidth, (float)longest*4*HUD_TEXT_SCALE) + 2*margin;
+    float height = lines.size()*lineHeight + graphHeight + 3*margin;
+    addRect(0, 0, width, height, background);
+
+    float y = margin;
+    for (const std::string& text : lines) {
+        addText(margin, y, text, white);
+        y += lineHeight;
+    }
+
+    // Frame time graph: bars over the target are red. The scale fits twice the target
+    y += margin;
+    double scaleMs = stats.targetMs > 0 ? 2*stats.targetMs : 33.3;
+    for (float ms : m_frameTimes) {
+        scaleMs = std::max(scaleMs, (double)ms);
+    }
+
+    float x = margin;
+    for (float ms : m_frameTimes) {
+        float barHeight = graphHeight*ms/scaleMs;
+        addRect(x, y + graphHeight - barHeight, 2.0f, barHeight, stats.targetMs > 0 && ms > stats.targetMs ? red : green);
+        x += 2.0f;
+    }
+    if (stats.targetMs > 0) {
+        float targetY = y + graphHeight - graphHeight*stats.targetMs/scaleMs;
+        addRect(margin, targetY, graphWidth, 1.0f, yellow);
+    }
+
+    // Upload and draw
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, m_vertices.size()*sizeof(float), m_vertices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    shader.Activate();
+    glUniform2f(shader.getUniformLocation("screenSize"), WIDTH, HEIGHT);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, m_fontTexture);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindVertexArray(m_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, m_vertices.size() / 8);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void PerfHud::Delete() {
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_VBO);
+    glDeleteTextures(1, &m_fontTexture);
+}
+
+#endif
@@ -6,6 +6,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// Movement keys held during a frame, as a bitmask
+enum MoveKey {
+    MOVE_FORWARD = 1,
+    MOVE_LEFT = 2,
+    MOVE_BACK = 4,
+    MOVE_RIGHT = 8
+};
+
 class Player
 {
 private:
@@ -25,11 +33,25 @@ public:
 
     // Utilites get / set functions
     glm::mat4 getView() const;
+    // View matrix relative to the corner of a chunk, so it stays precise far from the world's origin
+    glm::mat4 getView(glm::ivec3 originChunk) const;
     glm::vec3 getPosition() const;
     glm::ivec3 getChunkPosition() const;
+    glm::vec3 getFront() const;
+
+    // Returns the chunk position of any position
+    static glm::ivec3 toChunkPosition(glm::vec3 position);
 
     void cameraMouseCallback(GLFWwindow *window, float xpos, float ypos);
     void processCameraMovement(GLFWwindow *window, float deltaTime);
+
+    // Window-free versions of the two above, so that recorded input can drive the player.
+    // look() turns the camera towards a cursor position, move() moves for deltaTime seconds
+    // with the MoveKey bits of keys held
+    void look(float xpos, float ypos);
+    void move(unsigned int keys, float deltaTime);
+    // MoveKey bits of the keys held in a window
+    static unsigned int readMoveKeys(GLFWwindow *window);
 };
 
 // Generates a camera at (0, 0, 0)
@@ -66,6 +88,11 @@ glm::mat4 Player::getView() const {
     return glm::lookAt(m_position, m_position + m_front, m_up);
 }
 
+glm::mat4 Player::getView(glm::ivec3 originChunk) const {
+    glm::vec3 position = m_position - (float)SCALE_FACTOR*glm::vec3(originChunk*CHUNCK_SIZE);
+    return glm::lookAt(position, position + m_front, m_up);
+}
+
 // Returns player's position
 glm::vec3 Player::getPosition() const {
     return m_position;
@@ -73,7 +100,10 @@ glm::vec3 Player::getPosition() const {
 
 // Updates camera's orientation based on mouse position on window
 void Player::cameraMouseCallback(GLFWwindow *window, float xpos, float ypos) {
-    
+    look(xpos, ypos);
+}
+
+void Player::look(float xpos, float ypos) {
     // Cheks if mouse entered the window for the first time
     if (m_firstMouse)
     {
@@ -111,23 +141,45 @@ void Player::cameraMouseCallback(GLFWwindow *window, float xpos, float ypos) {
 
 // Updates camera's position based on WASD keys and speed
 void Player::processCameraMovement(GLFWwindow *window, float deltaTime) {
-    if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    move(readMoveKeys(window), deltaTime);
+}
+
+void Player::move(unsigned int keys, float deltaTime) {
+    if(keys & MOVE_FORWARD) {
 		m_position += m_speed*deltaTime*m_front;
 	}
-	if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+	if(keys & MOVE_LEFT) {
 		m_position -= m_speed*deltaTime*glm::normalize(glm::cross(m_front, m_up));
 	}
-	if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+	if(keys & MOVE_BACK) {
 		m_position -= m_speed*deltaTime*m_front;
 	}
-	if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+	if(keys & MOVE_RIGHT) {
 		m_position += m_speed*deltaTime*glm::normalize(glm::cross(m_front, m_up));
 	}
 }
 
+unsigned int Player::readMoveKeys(GLFWwindow *window) {
+    unsigned int keys = 0;
+    keys |= glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS ? MOVE_FORWARD : 0;
+    keys |= glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS ? MOVE_LEFT : 0;
+    keys |= glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS ? MOVE_BACK : 0;
+    keys |= glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS ? MOVE_RIGHT : 0;
+    return keys;
+}
+
+// Returns the direction the camera is looking at
+glm::vec3 Player::getFront() const {
+    return m_front;
+}
+
 glm::ivec3 Player::getChunkPosition() const {
+    return toChunkPosition(m_position);
+}
+
+glm::ivec3 Player::toChunkPosition(glm::vec3 position) {
     int chunkPosx, chunkPosy, chunkPosz;
-    glm::vec3 floatchunkpos = m_position/((float)CHUNCK_SIZE) + glm::vec3(1/((float)2*CHUNCK_SIZE));
+    glm::vec3 floatchunkpos = position/((float)CHUNCK_SIZE) + glm::vec3(1/((float)2*CHUNCK_SIZE));
     chunkPosx = floor(floatchunkpos.x);
     chunkPosy = floor(floatchunkpos.y);
     chunkPosz = floor(floatchunkpos.z);
@@ -0,0 +1,196 @@
+#ifndef CHUNK_PREFETCHER
+#define CHUNK_PREFETCHER
+
+#include <deque>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "chunkWindow.hpp"
+#include "player.hpp"
+
+// Position of the player at a given time
+struct PositionSample {
+    float time;
+    glm::vec3 position;
+};
+
+// Predicts which chunks are going to enter the window by extrapolating the player's
+// motion, so they can be loaded and meshed before they are needed
+class ChunkPrefetcher
+{
+private:
+    std::deque<PositionSample> m_history;
+
+    // Chunks predicted to enter the window, and the window centers they were predicted for
+    ChunkMap<bool> m_predicted;
+    std::vector<glm::ivec3> m_predictedCenters;
+    glm::ivec3 m_windowCenter;
+    // Incremented every time the prediction changes
+    unsigned int m_generation;
+
+    // Prefetched chunks waiting to enter the window
+    ChunkMap<std::unique_ptr<Chunk>> m_ready;
+
+    // Removes ready chunks that are no longer predicted
+    void dropUnpredicted();
+
+public:
+    ChunkPrefetcher();
+    virtual ~ChunkPrefetcher() = default;
+
+    // Adds a position to the history
+    void record(float time, glm::vec3 position);
+    // Average velocity over the history, in blocks per second
+    glm::vec3 getVelocity() const;
+
+    // Extrapolates the motion for horizon seconds and updates the predicted chunks.
+    // Returns the chunks that were not predicted before, which have to be prefetched
+    std::vector<glm::ivec3> predict(const ChunkWindow& window, float horizon);
+    bool isPredicted(glm::ivec3 chunkPos) const;
+    unsigned int getGeneration() const;
+
+    // Stores a prefetched chunk, unless it's no longer predicted
+    void store(std::unique_ptr<Chunk> chunk);
+    // Takes a prefetched chunk out of the prefetcher. Returns nullptr if it's not ready
+    std::unique_ptr<Chunk> take(glm::ivec3 chunkPos);
+    bool isReady(glm::ivec3 chunkPos) const;
+
+    size_t predictedCount() const;
+    size_t readyCount() const;
+};
+
+ChunkPrefetcher::ChunkPrefetcher() {
+    m_windowCenter = glm::ivec3(0, 0, 0);
+    m_generation = 0;
+}
+
+void ChunkPrefetcher::record(float time, glm::vec3 position) {
+    m_history.push_back({time, position});
+
+    // Keeps the samples of the last PREFETCH_HISTORY_SECONDS, and at least two of them
+    while (m_history.size() > 2 && m_history.back().time - m_history[1].time >= PREFETCH_HISTORY_SECONDS) {
+        m_history.pop_front();
+    }
+}
+
+glm::vec3 ChunkPrefetcher::getVelocity() const {
+    if (m_history.size() < 2) {
+        return glm::vec3(0, 0, 0);
+    }
+
+    float dt = m_history.back().time - m_history.front().time;
+    if (dt <= 0.0f) {
+        return glm::vec3(0, 0, 0);
+    }
+    return (m_history.back().position - m_history.front().position) / dt;
+}
+
+std::vector<glm::ivec3> ChunkPrefetcher::predict(const ChunkWindow& window, float horizon) {
+    std::vector<glm::ivec3> added;
+    if (m_history.empty()) {
+        return added;
+    }
+
+    glm::vec3 position = m_history.back().position;
+    glm::vec3 velocity = getVelocity();
+
+    // Samples the predicted path every half chunk
+    float distance = glm::length(velocity)*horizon;
+    int steps = std::min(64, (int)ceil(distance / (0.5f*CHUNCK_SIZE)));
+
+    std::vector<glm::ivec3> centers;
+    for (int i = 1; i <= steps; i++) {
+        glm::ivec3 center = Player::toChunkPosition(position + velocity*(horizon*i/steps));
+        if (center != window.getCenter() && (centers.empty() || centers.back() != center)) {
+            centers.push_back(center);
+        }
+    }
+
+    // Nothing to do if the prediction didn't change
+    if (centers == m_predictedCenters && window.getCenter() == m_windowCenter) {
+        return added;
+    }
+    m_predictedCenters = centers;
+    m_windowCenter = window.getCenter();
+
+    // Chunks of the predicted windows that are not in the current one
+    ChunkMap<bool> predicted;
+    int radius = window.getRadius();
+    for (glm::ivec3 center : centers) {
+        for (int i = -radius; i <= radius; i++) {
+            for (int j = -radius; j <= radius; j++) {
+                for (int k = -radius; k <= radius; k++) {
+                    glm::ivec3 pos = center + glm::ivec3(i, j, k);
+                    if (window.contains(pos) || !predicted.tryEmplace(pos.x, pos.y, pos.z).second) {
+                        continue;
+                    }
+                    if (m_predicted.find(pos.x, pos.y, pos.z) == nullptr) {
+                        added.push_back(pos);
+                    }
+                }
+            }
+        }
+    }
+
+    m_predicted = std::move(predicted);
+    m_generation++;
+    dropUnpredicted();
+    return added;
+}
+
+void ChunkPrefetcher::dropUnpredicted() {
+    std::vector<glm::ivec3> dropped;
+    m_ready.forEach([&](int x, int y, int z, std::unique_ptr<Chunk>&) {
+        if (m_predicted.find(x, y, z) == nullptr) {
+            dropped.push_back(glm::ivec3(x, y, z));
+        }
+    });
+
+    for (glm::ivec3 pos : dropped) {
+        m_ready.erase(pos.x, pos.y, pos.z);
+    }
+}
+
+bool ChunkPrefetcher::isPredicted(glm::ivec3 chunkPos) const {
+    return m_predicted.find(chunkPos.x, chunkPos.y, chunkPos.z) != nullptr;
+}
+
+void ChunkPrefetcher::store(std::unique_ptr<Chunk> chunk) {
+    glm::ivec3 pos = chunk->getChunkPos();
+    if (isPredicted(pos)) {
+        m_ready(pos.x, pos.y, pos.z) = std::move(chunk);
+    }
+}
+
+std::unique_ptr<Chunk> ChunkPrefetcher::take(glm::ivec3 chunkPos) {
+    std::unique_ptr<Chunk>* ready = m_ready.find(chunkPos.x, chunkPos.y, chunkPos.z);
+    if (ready == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Chunk> chunk = std::move(*ready);
+    m_ready.erase(chunkPos.x, chunkPos.y, chunkPos.z);
+    return chunk;
+}
+
+bool ChunkPrefetcher::isReady(glm::ivec3 chunkPos) const {
+    return m_ready.find(chunkPos.x, chunkPos.y, chunkPos.z) != nullptr;
+}
+
+unsigned int ChunkPrefetcher::getGeneration() const {
+    return m_generation;
+}
+
+size_t ChunkPrefetcher::predictedCount() const {
+    return m_predicted.size();
+}
+
+size_t ChunkPrefetcher::readyCount() const {
+    return m_ready.size();
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef WORLD_PREGEN
+#define WORLD_PREGEN
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "gamedata.hpp"
+#include "worldGenerator.hpp"
+#include "loader.hpp"
+
+namespace wl {
+
+// Generated chunk waiting to be written
+struct PregenChunk {
+    int x, y, z;
+    BlockGrid data;
+};
+
+// Generates every chunk with |x|, |z| <= radius and |y| <= height that is not in the
+// file yet. Chunks are generated by worker threads and written by the calling thread
+inline void pregenerate(WorldGenerator &generator, std::fstream &file, int radius, int height, int threadCount) {
+    // Chunks to generate
+    std::vector<ChunkKey> keys;
+    for (int x = -radius; x <= radius; x++) {
+        for (int y = -height; y <= height; y++) {
+            for (int z = -radius; z <= radius; z++) {
+                if (chunkIndex.find(x, y, z) == nullptr) {
+                    keys.push_back({x, y, z});
+                }
+            }
+        }
+    }
+
+    std::cout << "Pregenerating " << keys.size() << " chunks with " << threadCount << " threads\n";
+    if (keys.empty()) {
+        return;
+    }
+
+    // Generated chunks, bounded so that workers can't get too far ahead of the writer
+    std::deque<PregenChunk> done;
+    std::mutex doneMutex;
+    std::condition_variable doneNotEmpty, doneNotFull;
+    const size_t maxDone = 256;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        // Each thread has its own generator. Stage caches are shared, so a column's heightmap
+        // or a region's caves are computed once whichever thread needs them first
+        WorldGenerator localGenerator = generator;
+
+        for (size_t i = next++; i < keys.size(); i = next++) {
+            auto [x, y, z] = keys[i];
+            PregenChunk chunk {x, y, z, localGenerator.genChunk(x, y, z)};
+
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneNotFull.wait(lock, [&]() { return done.size() < maxDone; });
+            done.push_back(chunk);
+            doneNotEmpty.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(worker);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    for (size_t written = 0; written < keys.size(); written++) {
+        PregenChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneNotEmpty.wait(lock, [&]() { return !done.empty(); });
+            chunk = done.front();
+            done.pop_front();
+            doneNotFull.notify_one();
+        }
+
+        writeChunk(file, chunk.x, chunk.y, chunk.z, chunk.data);
+
+        // Reports progress about once a second
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(1) || written + 1 == keys.size()) {
+            lastReport = now;
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            std::cout << "Generated " << written + 1 << "/" << keys.size() << " chunks ("
+                << (int)(100.0*(written + 1)/keys.size()) << "%), "
+                << (int)((written + 1)/std::max(elapsed, 1e-6)) << " chunks/s\n";
+        }
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    file.flush();
+
+    #ifdef DEBUG
+    generator.printStats();
+    #endif
+}
+
+}
+#endif
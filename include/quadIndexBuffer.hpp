@@ -0,0 +1,128 @@
+#ifndef QUAD_INDEX_BUFFER
+#define QUAD_INDEX_BUFFER
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include "gamedata.hpp"
+
+// Largest number of quads in a chunk mesh: every face of every block
+#define MAX_CHUNK_QUADS (CHUNCK_SIZE*CHUNCK_SIZE*CHUNCK_SIZE*6)
+
+// Chunks are drawn one by one with a base vertex, so indices only have to address
+// the vertices of a single chunk: 16 bit indices are used when they are enough
+using QuadIndex = std::conditional_t<4*MAX_CHUNK_QUADS <= 65536, uint16_t, uint32_t>;
+#define QUAD_INDEX_TYPE (sizeof(QuadIndex) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT)
+
+// Index buffer shared by every chunk. Every quad uses the same
+// 0, 1, 2, 0, 2, 3 pattern, offset by 4 vertices per quad
+class QuadIndexBuffer
+{
+private:
+    GLuint m_EBO;
+
+public:
+    QuadIndexBuffer();
+    virtual ~QuadIndexBuffer() = default;
+
+    // Generates and uploads the indices for MAX_CHUNK_QUADS quads
+    void create();
+    // Binds the buffer to the currently bound VAO
+    void bind() const;
+    void Delete();
+};
+
+// Chunk meshes to draw with a single glMultiDrawElementsBaseVertex call
+class ChunkDrawList
+{
+private:
+    std::vector<GLsizei> m_counts;
+    std::vector<GLint> m_baseVertices;
+    // Every draw starts from the beginning of the shared index buffer
+    std::vector<const void*> m_offsets;
+
+public:
+    void clear();
+    // Adds a chunk mesh starting at baseVertex
+    void add(GLint baseVertex, unsigned int quadCount);
+    // Draws every chunk mesh added. The VAO must be bound
+    void draw() const;
+
+    size_t size() const;
+    // Number of triangles drawn
+    size_t triangleCount() const;
+};
+
+QuadIndexBuffer::QuadIndexBuffer() {
+    m_EBO = 0;
+}
+
+void QuadIndexBuffer::create() {
+    std::vector<QuadIndex> indices;
+    indices.reserve(6*MAX_CHUNK_QUADS);
+
+    for (unsigned int quad = 0; quad < MAX_CHUNK_QUADS; quad++) {
+        QuadIndex start = 4*quad;
+        indices.push_back(start + 0);
+        indices.push_back(start + 1);
+        indices.push_back(start + 2);
+
+        indices.push_back(start + 0);
+        indices.push_back(start + 2);
+        indices.push_back(start + 3);
+    }
+
+    glGenBuffers(1, &m_EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(QuadIndex)*indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void QuadIndexBuffer::bind() const {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+}
+
+void QuadIndexBuffer::Delete() {
+    glDeleteBuffers(1, &m_EBO);
+}
+
+void ChunkDrawList::clear() {
+    m_counts.clear();
+    m_baseVertices.clear();
+    m_offsets.clear();
+}
+
+void ChunkDrawList::add(GLint baseVertex, unsigned int quadCount) {
+    // Empty chunks are not drawn at all
+    if (quadCount == 0) {
+        return;
+    }
+
+    m_counts.push_back(6*quadCount);
+    m_baseVertices.push_back(baseVertex);
+    m_offsets.push_back(nullptr);
+}
+
+void ChunkDrawList::draw() const {
+    if (m_counts.empty()) {
+        return;
+    }
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_counts.data(), QUAD_INDEX_TYPE, m_offsets.data(),
+        m_counts.size(), m_baseVertices.data());
+}
+
+size_t ChunkDrawList::size() const {
+    return m_counts.size();
+}
+
+size_t ChunkDrawList::triangleCount() const {
+    size_t triangles = 0;
+    for (GLsizei count : m_counts) {
+        triangles += count / 3;
+    }
+    return triangles;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef REGION_CACHE
+#define REGION_CACHE
+
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <cstdint>
+#include "chunkMap.hpp"
+
+// Outputs of a world generation stage, keyed by region coordinates. Outputs are immutable
+// once computed, so they are shared between threads without copies. Bounded: the oldest
+// regions are dropped first, they are computed again if needed
+template <typename T>
+class RegionCache
+{
+private:
+    mutable std::mutex m_mutex;
+    ChunkMap<std::shared_ptr<const T>> m_regions;
+    // Regions in insertion order, oldest first
+    std::deque<uint64_t> m_order;
+    size_t m_capacity;
+
+    size_t m_hits;
+    size_t m_misses;
+
+public:
+    RegionCache(size_t capacity);
+    virtual ~RegionCache() = default;
+
+    // Returns the output of a region, computing it with compute() if it's not cached.
+    // compute runs without the lock held, so threads can compute different regions at once
+    template <typename F>
+    std::shared_ptr<const T> get(int x, int y, int z, F compute);
+
+    size_t getHits() const;
+    size_t getMisses() const;
+};
+
+template <typename T>
+RegionCache<T>::RegionCache(size_t capacity) {
+    m_capacity = capacity;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+template <typename T>
+template <typename F>
+std::shared_ptr<const T> RegionCache<T>::get(int x, int y, int z, F compute) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::shared_ptr<const T>* cached = m_regions.find(x, y, z);
+        if (cached != nullptr) {
+            m_hits++;
+            return *cached;
+        }
+        m_misses++;
+    }
+
+    std::shared_ptr<const T> output = std::make_shared<const T>(compute());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [slot, inserted] = m_regions.tryEmplace(x, y, z);
+    // Another thread computed the same region meanwhile: both outputs are the same
+    if (!inserted) {
+        return *slot;
+    }
+    *slot = output;
+    m_order.push_back(ChunkMap<bool>::encode(x, y, z));
+
+    while (m_order.size() > m_capacity) {
+        int ox, oy, oz;
+        ChunkMap<bool>::decode(m_order.front(), ox, oy, oz);
+        m_regions.erase(ox, oy, oz);
+        m_order.pop_front();
+    }
+    return output;
+}
+
+template <typename T>
+size_t RegionCache<T>::getHits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+template <typename T>
+size_t RegionCache<T>::getMisses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef RENDER_DISTANCE_CONTROLLER
+#define RENDER_DISTANCE_CONTROLLER
+
+#include <algorithm>
+#include <cstddef>
+#include "gamedata.hpp"
+
+// Hysteresis: the radius shrinks when frames take more than SHRINK_RATIO times the target
+// and grows when they take less than GROW_RATIO times it, for HOLD_SECONDS in a row
+#define RENDER_DISTANCE_SHRINK_RATIO 1.1
+#define RENDER_DISTANCE_GROW_RATIO 0.7
+#define RENDER_DISTANCE_HOLD_SECONDS 1.0
+// Time for the pipeline to settle after a change, before frames are judged again
+#define RENDER_DISTANCE_COOLDOWN_SECONDS 2.0
+// Time constant of the frame time average, in seconds
+#define RENDER_DISTANCE_SMOOTHING_SECONDS 0.5
+
+// Picks the render distance at runtime, to hold a frame time target on any machine and
+// in any scene. The radius only grows while the chunk pipeline keeps up: a backlog means
+// the current window isn't even loaded yet
+class RenderDistanceController
+{
+private:
+    double m_targetMs;
+    int m_radius;
+    int m_minRadius;
+    int m_maxRadius;
+    // Largest backlog with which the radius can still grow
+    size_t m_maxBacklog;
+
+    // Smoothed frame time
+    double m_averageMs;
+    // Seconds the average has been over or under the target
+    double m_overTime;
+    double m_underTime;
+    // Seconds left before frames are judged again
+    double m_cooldown;
+
+public:
+    // A target of 0 or less keeps the radius fixed
+    RenderDistanceController(int radius, double targetMs, int minRadius, int maxRadius, size_t maxBacklog);
+    virtual ~RenderDistanceController() = default;
+
+    // Records a frame that lasted frameSeconds, of which frameMs milliseconds were spent working
+    // on it, with backlog chunk tasks and uploads pending. Returns the radius to use
+    int update(double frameSeconds, double frameMs, size_t backlog);
+
+    bool isEnabled() const;
+    int getRadius() const;
+    double getAverageMs() const;
+};
+
+RenderDistanceController::RenderDistanceController(int radius, double targetMs, int minRadius, int maxRadius, size_t maxBacklog) {
+    m_targetMs = targetMs;
+    m_minRadius = minRadius;
+    m_maxRadius = std::max(minRadius, maxRadius);
+    m_radius = std::clamp(radius, m_minRadius, m_maxRadius);
+    m_maxBacklog = maxBacklog;
+
+    m_averageMs = 0.0;
+    m_overTime = 0.0;
+    m_underTime = 0.0;
+    m_cooldown = RENDER_DISTANCE_COOLDOWN_SECONDS;
+
+    if (!isEnabled()) {
+        m_radius = radius;
+    }
+}
+
+int RenderDistanceController::update(double frameSeconds, double frameMs, size_t backlog) {
+    if (!isEnabled()) {
+        return m_radius;
+    }
+
+    double alpha = std::min(1.0, frameSeconds / RENDER_DISTANCE_SMOOTHING_SECONDS);
+    m_averageMs += alpha*(frameMs - m_averageMs);
+
+    // Frames right after a change pay for loading the new chunks
+    if (m_cooldown > 0.0) {
+        m_cooldown -= frameSeconds;
+        return m_radius;
+    }
+
+    m_overTime = m_averageMs > RENDER_DISTANCE_SHRINK_RATIO*m_targetMs ? m_overTime + frameSeconds : 0.0;
+    m_underTime = m_averageMs < RENDER_DISTANCE_GROW_RATIO*m_targetMs && backlog <= m_maxBacklog ? m_underTime + frameSeconds : 0.0;
+
+    int radius = m_radius;
+    if (m_overTime >= RENDER_DISTANCE_HOLD_SECONDS) {
+        radius = std::max(m_minRadius, m_radius - 1);
+    } else if (m_underTime >= RENDER_DISTANCE_HOLD_SECONDS) {
+        radius = std::min(m_maxRadius, m_radius + 1);
+    }
+
+    if (radius != m_radius) {
+        m_radius = radius;
+        m_overTime = 0.0;
+        m_underTime = 0.0;
+        m_cooldown = RENDER_DISTANCE_COOLDOWN_SECONDS;
+    }
+    return m_radius;
+}
+
+bool RenderDistanceController::isEnabled() const {
+    return m_targetMs > 0.0;
+}
+
+int RenderDistanceController::getRadius() const {
+    return m_radius;
+}
+
+double RenderDistanceController::getAverageMs() const {
+    return m_averageMs;
+}
+
+#endif
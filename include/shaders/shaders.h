@@ -8,11 +8,27 @@
 #include<sstream>
 #include<iostream>
 #include<cerrno>
+#include<unordered_map>
+
+// Folder where linked program binaries are cached
+#define SHADER_CACHE_DIR "../shader_cache/"
 
 std::string get_file_contents(const char* filename);
 
 class Shader
 {
+private:
+	// Uniform locations, resolved once after linking
+	std::unordered_map<std::string, GLint> m_uniformLocations;
+
+	// Compiles and links the Shader Program from source
+	bool compile(const char* vertexSource, const char* fragmentSource);
+	// Loads / saves the linked program from the program binary cache
+	bool loadBinary(const std::string& cacheFile);
+	void saveBinary(const std::string& cacheFile) const;
+	// Fills m_uniformLocations with every active uniform of the program
+	void cacheUniformLocations();
+
 public:
 	// Reference ID of the Shader Program
 	GLuint ID;
@@ -24,9 +40,14 @@ public:
 	// Deletes the Shader Program
 	void Delete();
 
+	// Returns the cached location of a uniform, -1 if the program doesn't use it
+	GLint getUniformLocation(const std::string &name) const;
+
 	// Uniform function
 	void setBool(const std::string &name, bool value) const;
 	void setInt(const std::string &name, int value) const;
 	void setFloat(const std::string &name, float value) const;
+	void setVec3(const std::string &name, float x, float y, float z) const;
+	void setMat4(const std::string &name, const float* value) const;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,249 @@
+#ifndef STAGING_RING
+#define STAGING_RING
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "gamedata.hpp"
+
+// glBufferStorage (OpenGL 4.4 / ARB_buffer_storage). Loaded at runtime since it's
+// not part of the 3.3 context we request
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP BufferStorageFn)(GLenum, GLsizeiptr, const void*, GLbitfield);
+
+// Part of the ring written during a frame, free again once the GPU passed its fence
+struct RingFence {
+    GLsync fence;
+    size_t begin, end;
+};
+
+// Streams data to GPU buffers through a staging buffer used as a ring. Data is written in
+// the staging buffer and copied on the GPU with glCopyBufferSubData, so uploads never
+// reallocate the destination buffer or wait for it to be idle.
+// When glBufferStorage is available the ring is mapped once, persistently, and can be written
+// from any thread between reserve() and submit(). Otherwise every reservation is mapped
+// unsynchronized, and the buffer is orphaned when the ring wraps
+class StagingRing
+{
+private:
+    GLuint m_buffer;
+    size_t m_size;
+    bool m_persistent;
+    // Persistent mapping of the whole ring, or the currently mapped reservation
+    uint8_t* m_mapped;
+
+    // Next free byte
+    size_t m_head;
+    // Start of the data written since the last fence
+    size_t m_frameBegin;
+    // Fences of the previous frames, oldest first
+    std::deque<RingFence> m_fences;
+
+    // Bytes that can still be reserved during this frame
+    size_t m_frameBudget;
+    size_t m_frameRemaining;
+
+    // Waits for the GPU to finish reading the part of the ring in [begin, end)
+    void waitFor(size_t begin, size_t end);
+
+public:
+    StagingRing();
+    virtual ~StagingRing() = default;
+
+    // Creates a ring of size bytes, that can upload up to frameBudget bytes per frame
+    void create(size_t size, size_t frameBudget);
+    bool isPersistent() const;
+
+    // Reserves size bytes to write data in, and returns where to write it. Returns nullptr if the
+    // frame's budget is used up: the upload should be retried next frame
+    void* reserve(size_t size);
+    // Copies the data written in the last reservation to dst at dstOffset
+    void submit(GLuint dst, GLintptr dstOffset, size_t size);
+    // Reserves, writes and submits data. Returns false if the frame's budget is used up
+    bool upload(GLuint dst, GLintptr dstOffset, const void* data, size_t size);
+
+    // Fences the data written during the frame and resets the budget. Call once per frame
+    void endFrame();
+    size_t getFrameRemaining() const;
+    // Bytes uploaded since the last endFrame()
+    size_t getFrameUploaded() const;
+    void Delete();
+};
+
+StagingRing::StagingRing() {
+    m_buffer = 0;
+    m_size = 0;
+    m_persistent = false;
+    m_mapped = nullptr;
+    m_head = 0;
+    m_frameBegin = 0;
+    m_frameBudget = 0;
+    m_frameRemaining = 0;
+}
+
+void StagingRing::create(size_t size, size_t frameBudget) {
+    m_size = size;
+    // A frame can't use more than half the ring, so the previous frames' data can be in flight
+    m_frameBudget = std::min(frameBudget, size / 2);
+    m_frameRemaining = m_frameBudget;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+
+    BufferStorageFn pfnBufferStorage = nullptr;
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage")) {
+        pfnBufferStorage = (BufferStorageFn)glfwGetProcAddress("glBufferStorage");
+    }
+
+    if (pfnBufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        pfnBufferStorage(GL_COPY_READ_BUFFER, m_size, nullptr, flags);
+        m_mapped = (uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, m_size, flags);
+        m_persistent = m_mapped != nullptr;
+    }
+
+    if (!m_persistent) {
+        glBufferData(GL_COPY_READ_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    #ifdef DEBUG
+    std::cout << "Staging ring: " << m_size/1024 << " KB, " << (m_persistent ? "persistent mapping\n" : "orphaning\n");
+    #endif
+}
+
+bool StagingRing::isPersistent() const {
+    return m_persistent;
+}
+
+void StagingRing::waitFor(size_t begin, size_t end) {
+    auto overlaps = [&]() {
+        for (const RingFence& fence : m_fences) {
+            if (fence.begin < end && fence.end > begin) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Fences are signaled in order, so the oldest ones are waited first
+    while (overlaps()) {
+        glClientWaitSync(m_fences.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(m_fences.front().fence);
+        m_fences.pop_front();
+    }
+}
+
+void* StagingRing::reserve(size_t size) {
+    if (size > m_frameRemaining) {
+        return nullptr;
+    }
+    m_frameRemaining -= size;
+
+    // Wraps to the start of the ring when the data doesn't fit at the end
+    if (m_head + size > m_size) {
+        if (m_head > m_frameBegin) {
+            // Keeps the fenced part written before the wrap
+            m_fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), m_frameBegin, m_head});
+        }
+        m_head = 0;
+        m_frameBegin = 0;
+
+        // The old storage is still read by pending copies: the driver gives us a new one
+        if (!m_persistent) {
+            glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+            glBufferData(GL_COPY_READ_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            for (RingFence& fence : m_fences) {
+                glDeleteSync(fence.fence);
+            }
+            m_fences.clear();
+        }
+    }
+
+    if (m_persistent) {
+        waitFor(m_head, m_head + size);
+        return m_mapped + m_head;
+    }
+
+    // Fences are only needed across wraps with orphaning: ranges are never reused before one
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+    m_mapped = (uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, m_head, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return m_mapped;
+}
+
+void StagingRing::submit(GLuint dst, GLintptr dstOffset, size_t size) {
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+    if (!m_persistent) {
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        m_mapped = nullptr;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, m_head, dstOffset, size);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    m_head += size;
+}
+
+bool StagingRing::upload(GLuint dst, GLintptr dstOffset, const void* data, size_t size) {
+    void* target = reserve(size);
+    if (target == nullptr) {
+        return false;
+    }
+
+    memcpy(target, data, size);
+    submit(dst, dstOffset, size);
+    return true;
+}
+
+void StagingRing::endFrame() {
+    if (m_persistent && m_head > m_frameBegin) {
+        m_fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), m_frameBegin, m_head});
+    }
+    m_frameBegin = m_head;
+    m_frameRemaining = m_frameBudget;
+
+    // Drops the fences the GPU already passed
+    while (!m_fences.empty() && glClientWaitSync(m_fences.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+        glDeleteSync(m_fences.front().fence);
+        m_fences.pop_front();
+    }
+}
+
+size_t StagingRing::getFrameRemaining() const {
+    return m_frameRemaining;
+}
+
+size_t StagingRing::getFrameUploaded() const {
+    return m_frameBudget - m_frameRemaining;
+}
+
+void StagingRing::Delete() {
+    for (RingFence& fence : m_fences) {
+        glDeleteSync(fence.fence);
+    }
+    m_fences.clear();
+
+    if (m_persistent) {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &m_buffer);
+}
+
+#endif
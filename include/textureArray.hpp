@@ -0,0 +1,327 @@
+#ifndef TEXTURE_ARRAY
+#define TEXTURE_ARRAY
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include "gamedata.hpp"
+
+// Declarations only: the implementation is compiled once, by the file that defines
+// STB_IMAGE_IMPLEMENTATION before including this header
+#pragma push_macro("STB_IMAGE_IMPLEMENTATION")
+#undef STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#pragma pop_macro("STB_IMAGE_IMPLEMENTATION")
+
+// Header of the preprocessed texture cache file
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    int32_t width, height, levels, layers;
+};
+
+// All block textures in a single GL_TEXTURE_2D_ARRAY, the layer of a texture is its ID.
+// Decoded and mipmapped textures are cached in a file, so they are only decoded again
+// when a source image changes
+class TextureArray
+{
+private:
+    GLuint m_ID;
+    int m_width, m_height, m_levels, m_layers;
+    // RGBA texels of every mip level, each level stores all layers one after the other
+    std::vector<unsigned char> m_data;
+
+    // Hash of the source files' names, sizes and modification times
+    uint64_t hashSources(const idTexture* textures, int count) const;
+
+    // Decodes all images in parallel into level 0
+    void decode(const idTexture* textures, int count);
+    // Computes every mip level from level 0
+    void generateMipmaps();
+    // Sends m_data to OpenGL
+    void upload();
+
+    bool loadCache(const char* cachePath, uint64_t sourceHash);
+    void saveCache(const char* cachePath, uint64_t sourceHash) const;
+
+    // Size in bytes of one layer of a mip level
+    size_t layerSize(int level) const;
+
+public:
+    TextureArray();
+    virtual ~TextureArray() = default;
+
+    // Loads the textures from the cache, or decodes them if the cache is missing or stale
+    void load(const idTexture* textures, int count, const char* cachePath);
+
+    // Binds the texture array to a texture unit
+    void bind(unsigned int unit) const;
+    void Delete();
+
+    GLuint getID() const;
+    int getLayers() const;
+};
+
+TextureArray::TextureArray() {
+    m_ID = 0;
+    m_width = 0; m_height = 0;
+    m_levels = 0; m_layers = 0;
+}
+
+void TextureArray::load(const idTexture* textures, int count, const char* cachePath) {
+    #ifdef DEBUG
+    float startTime = glfwGetTime();
+    #endif
+
+    uint64_t sourceHash = hashSources(textures, count);
+
+    if (!loadCache(cachePath, sourceHash)) {
+        decode(textures, count);
+        generateMipmaps();
+        saveCache(cachePath, sourceHash);
+
+        #ifdef DEBUG
+        std::cout << "Decoded " << m_layers << " textures\n";
+        #endif
+    }
+
+    upload();
+
+    // Texel data is now owned by OpenGL
+    m_data.clear();
+    m_data.shrink_to_fit();
+
+    #ifdef DEBUG
+    std::cout << "Loaded texture array in " << glfwGetTime() - startTime << "s\n";
+    #endif
+}
+
+uint64_t TextureArray::hashSources(const idTexture* textures, int count) const {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto addBytes = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    addBytes(&count, sizeof(count));
+    for (int i = 0; i < count; i++) {
+        addBytes(&textures[i].ID, sizeof(textures[i].ID));
+        addBytes(textures[i].filename, strlen(textures[i].filename));
+
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(textures[i].filename, error);
+        long long time = std::filesystem::last_write_time(textures[i].filename, error).time_since_epoch().count();
+        addBytes(&size, sizeof(size));
+        addBytes(&time, sizeof(time));
+    }
+    return hash;
+}
+
+void TextureArray::decode(const idTexture* textures, int count) {
+    // One layer for every ID up to the biggest one
+    m_layers = 0;
+    for (int i = 0; i < count; i++) {
+        m_layers = std::max(m_layers, (int)textures[i].ID + 1);
+    }
+
+    // Decoded images, stbi_load is safe to call from many threads
+    struct Image {
+        unsigned char* data = nullptr;
+        int width = 0, height = 0;
+    };
+    std::vector<Image> images(count);
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            int channels;
+            images[i].data = stbi_load(textures[i].filename, &images[i].width, &images[i].height, &channels, 4);
+        }
+    };
+
+    int threadCount = std::min((int)std::max(1u, std::thread::hardware_concurrency()), count);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // All layers take the size of the first texture that loaded
+    m_width = 0; m_height = 0;
+    for (const Image& image : images) {
+        if (image.data) {
+            m_width = image.width;
+            m_height = image.height;
+            break;
+        }
+    }
+    if (m_width == 0) {
+        std::cout << "Failed to load the textures" << std::endl;
+        m_width = 1; m_height = 1;
+    }
+
+    m_levels = 1 + (int)floor(log2(std::max(m_width, m_height)));
+
+    size_t total = 0;
+    for (int level = 0; level < m_levels; level++) {
+        total += layerSize(level)*m_layers;
+    }
+    // Layers without a texture are left magenta
+    m_data.assign(total, 0);
+    for (size_t i = 0; i < layerSize(0)*m_layers; i += 4) {
+        m_data[i] = 255; m_data[i + 2] = 255; m_data[i + 3] = 255;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Image& image = images[i];
+        if (!image.data) {
+            std::cout << "Failed to load the texture " << textures[i].filename << std::endl;
+            continue;
+        }
+
+        // Copies the image to its layer, resampling it if its size is different
+        unsigned char* layer = &m_data[layerSize(0)*textures[i].ID];
+        for (int y = 0; y < m_height; y++) {
+            for (int x = 0; x < m_width; x++) {
+                int sx = x*image.width / m_width;
+                int sy = y*image.height / m_height;
+                memcpy(&layer[4*(y*m_width + x)], &image.data[4*(sy*image.width + sx)], 4);
+            }
+        }
+
+        stbi_image_free(image.data);
+    }
+}
+
+void TextureArray::generateMipmaps() {
+    size_t source = 0;
+    for (int level = 1; level < m_levels; level++) {
+        size_t destination = source + layerSize(level - 1)*m_layers;
+
+        int sw = std::max(1, m_width >> (level - 1)), sh = std::max(1, m_height >> (level - 1));
+        int dw = std::max(1, m_width >> level), dh = std::max(1, m_height >> level);
+
+        // 2x2 box filter, clamped on odd sizes
+        for (int layer = 0; layer < m_layers; layer++) {
+            const unsigned char* src = &m_data[source + layerSize(level - 1)*layer];
+            unsigned char* dst = &m_data[destination + layerSize(level)*layer];
+
+            for (int y = 0; y < dh; y++) {
+                for (int x = 0; x < dw; x++) {
+                    int x0 = std::min(2*x, sw - 1), x1 = std::min(2*x + 1, sw - 1);
+                    int y0 = std::min(2*y, sh - 1), y1 = std::min(2*y + 1, sh - 1);
+                    for (int c = 0; c < 4; c++) {
+                        int sum = src[4*(y0*sw + x0) + c] + src[4*(y0*sw + x1) + c]
+                            + src[4*(y1*sw + x0) + c] + src[4*(y1*sw + x1) + c];
+                        dst[4*(y*dw + x) + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        source = destination;
+    }
+}
+
+void TextureArray::upload() {
+    glGenTextures(1, &m_ID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_ID);
+
+    // sets filtering options
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+
+    // Rows of small mip levels are not 4 bytes aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t offset = 0;
+    for (int level = 0; level < m_levels; level++) {
+        int w = std::max(1, m_width >> level), h = std::max(1, m_height >> level);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, m_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &m_data[offset]);
+        offset += layerSize(level)*m_layers;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+bool TextureArray::loadCache(const char* cachePath, uint64_t sourceHash) {
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    TextureCacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, "MC2T", 4) != 0 || header.version != TEXTURE_CACHE_VERSION
+        || header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    m_width = header.width; m_height = header.height;
+    m_levels = header.levels; m_layers = header.layers;
+
+    size_t total = 0;
+    for (int level = 0; level < m_levels; level++) {
+        total += layerSize(level)*m_layers;
+    }
+
+    m_data.resize(total);
+    file.read(reinterpret_cast<char*>(m_data.data()), total);
+    return (bool)file;
+}
+
+void TextureArray::saveCache(const char* cachePath, uint64_t sourceHash) const {
+    std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error writing texture cache\n";
+        return;
+    }
+
+    TextureCacheHeader header {{'M', 'C', '2', 'T'}, TEXTURE_CACHE_VERSION, sourceHash,
+        m_width, m_height, m_levels, m_layers};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+}
+
+size_t TextureArray::layerSize(int level) const {
+    return (size_t)std::max(1, m_width >> level)*std::max(1, m_height >> level)*4;
+}
+
+void TextureArray::bind(unsigned int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_ID);
+}
+
+void TextureArray::Delete() {
+    glDeleteTextures(1, &m_ID);
+}
+
+GLuint TextureArray::getID() const {
+    return m_ID;
+}
+
+int TextureArray::getLayers() const {
+    return m_layers;
+}
+
+#endif
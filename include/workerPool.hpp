@@ -0,0 +1,167 @@
+#ifndef WORKER_POOL
+#define WORKER_POOL
+
+#include <coroutine>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <limits>
+#include <glm/glm.hpp>
+#include "gamedata.hpp"
+#include "async.hpp"
+
+// Threads that run chunk coroutines. A coroutine moves to a worker with
+// co_await pool.schedule(pos, priority, token) and is resumed there in priority order, lowest
+// first. Cancelled work is moved to the front by reprioritize(), so that it can stop early
+class WorkerPool
+{
+private:
+    struct Job {
+        glm::ivec3 pos;
+        float priority;
+        CancelToken token;
+        std::coroutine_handle<> handle;
+    };
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    // Min heap on priority
+    std::vector<Job> m_jobs;
+    bool m_stopping;
+
+    static bool compare(const Job& a, const Job& b);
+    void run(int worker);
+
+public:
+    struct Awaiter {
+        WorkerPool* pool;
+        glm::ivec3 pos;
+        float priority;
+        CancelToken token;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    WorkerPool();
+    virtual ~WorkerPool();
+
+    void start(int threadCount);
+    // Resumes every waiting job, so that cancelled work can finish, then joins the threads
+    void stop();
+
+    // Continues the awaiting coroutine on a worker. priority orders the jobs, pos lets
+    // reprioritize() compute it again later
+    Awaiter schedule(glm::ivec3 pos, float priority, CancelToken token);
+    // Computes every waiting job's priority again with score(pos). Cancelled jobs go first:
+    // they only have to notice it and stop
+    template <typename F>
+    void reprioritize(F score);
+
+    // Index of the calling worker in [0, getThreadCount()), or -1 outside the pool
+    static int currentWorker();
+    int getThreadCount() const;
+    size_t pendingCount();
+};
+
+// Set by each worker thread
+inline thread_local int workerIndex = -1;
+
+WorkerPool::WorkerPool() {
+    m_stopping = false;
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+bool WorkerPool::compare(const Job& a, const Job& b) {
+    return a.priority > b.priority;
+}
+
+void WorkerPool::start(int threadCount) {
+    m_stopping = false;
+    for (int i = 0; i < threadCount; i++) {
+        m_threads.emplace_back(&WorkerPool::run, this, i);
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void WorkerPool::run(int worker) {
+    workerIndex = worker;
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                return;
+            }
+
+            std::pop_heap(m_jobs.begin(), m_jobs.end(), compare);
+            job = m_jobs.back();
+            m_jobs.pop_back();
+        }
+
+        job.handle.resume();
+    }
+}
+
+void WorkerPool::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+    // Once the job is queued a worker can resume the coroutine and destroy this awaiter,
+    // so nothing of it is used after the push
+    WorkerPool* target = pool;
+    {
+        std::lock_guard<std::mutex> lock(target->m_mutex);
+        target->m_jobs.push_back({pos, priority, token, handle});
+        std::push_heap(target->m_jobs.begin(), target->m_jobs.end(), compare);
+    }
+    target->m_wake.notify_one();
+}
+
+WorkerPool::Awaiter WorkerPool::schedule(glm::ivec3 pos, float priority, CancelToken token) {
+    return Awaiter{this, pos, priority, token};
+}
+
+template <typename F>
+void WorkerPool::reprioritize(F score) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Job& job : m_jobs) {
+        job.priority = job.token.isCancelled() ? -std::numeric_limits<float>::infinity() : score(job.pos);
+    }
+    std::make_heap(m_jobs.begin(), m_jobs.end(), compare);
+}
+
+int WorkerPool::currentWorker() {
+    return workerIndex;
+}
+
+int WorkerPool::getThreadCount() const {
+    return m_threads.size();
+}
+
+size_t WorkerPool::pendingCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef WORLD
+#define WORLD
+
+#include <atomic>
+#include <memory>
+#include "gamedata.hpp"
+#include "chunk.hpp"
+#include "chunkMap.hpp"
+#include "chunkStore.hpp"
+#include "epoch.hpp"
+#include "loader.hpp"
+
+// Blocks of every published chunk, by chunk position. A table is never modified once
+// published: the writer publishes a new one
+using WorldTable = ChunkMap<const BlockGrid*>;
+
+// Read access to a published version of the world. Only valid inside World::read()
+class WorldReader
+{
+private:
+    const WorldTable* m_table;
+
+public:
+    WorldReader(const WorldTable* table);
+    virtual ~WorldReader() = default;
+
+    // Returns the blocks of a chunk, or nullptr if it's not loaded
+    const BlockGrid* chunkBlocks(glm::ivec3 chunkPos) const;
+    // Reads a block at a world block position. Returns false if its chunk is not loaded
+    bool getBlock(glm::ivec3 blockPos, blockType& block) const;
+    size_t chunkCount() const;
+};
+
+// Owns chunk residency. The main thread loads, edits and releases chunks through the
+// ChunkStore and publishes the result once per frame. Other threads (meshers, raycasts,
+// lighting, saving) read the published version without locks: grids and tables replaced by
+// a publish are retired, and freed only once no reader can still hold them.
+// Readers see block grids, not Chunk objects: meshes and occupancy stay on the main thread
+class World
+{
+private:
+    ChunkStore m_store;
+    mutable EpochDomain m_epochs;
+
+    // Table read by readers
+    std::atomic<const WorldTable*> m_table;
+    // Writer side: the published table and the grids it points to, kept alive until retired
+    std::shared_ptr<const WorldTable> m_current;
+    ChunkMap<std::shared_ptr<const BlockGrid>> m_grids;
+
+public:
+    World();
+    virtual ~World() = default;
+
+    ChunkStore& getStore();
+    const ChunkStore& getStore() const;
+
+    // Main thread only: makes the chunks loaded, released or edited since the last publish
+    // visible to readers. Unchanged grids aren't copied: chunks share them copy-on-write
+    void publish();
+
+    // Any thread: calls f(const WorldReader&) with the last published version pinned.
+    // Returns what f returns. Pointers read from it must not be kept after f returns
+    template <typename F>
+    auto read(F f) const;
+
+    size_t publishedCount() const;
+    // Retired grids and tables not freed yet
+    size_t retiredCount() const;
+    size_t freedCount() const;
+};
+
+WorldReader::WorldReader(const WorldTable* table) {
+    m_table = table;
+}
+
+const BlockGrid* WorldReader::chunkBlocks(glm::ivec3 chunkPos) const {
+    const BlockGrid* const* blocks = m_table->find(chunkPos.x, chunkPos.y, chunkPos.z);
+    return blocks == nullptr ? nullptr : *blocks;
+}
+
+bool WorldReader::getBlock(glm::ivec3 blockPos, blockType& block) const {
+    glm::ivec3 chunkPos = wl::blockToChunk(blockPos);
+    const BlockGrid* blocks = chunkBlocks(chunkPos);
+    if (blocks == nullptr) {
+        return false;
+    }
+
+    glm::ivec3 local = blockPos - chunkPos*CHUNCK_SIZE;
+    block = blocks->blocks[local.x][local.y][local.z];
+    return true;
+}
+
+size_t WorldReader::chunkCount() const {
+    return m_table->size();
+}
+
+World::World() {
+    m_current = std::make_shared<const WorldTable>();
+    m_table = m_current.get();
+}
+
+ChunkStore& World::getStore() {
+    return m_store;
+}
+
+const ChunkStore& World::getStore() const {
+    return m_store;
+}
+
+void World::publish() {
+    // Copied from the current table on the first change
+    std::shared_ptr<WorldTable> table;
+
+    m_store.takeChanges([&](glm::ivec3 pos) {
+        Chunk* chunk = m_store.at(pos);
+        std::shared_ptr<const BlockGrid> grid = chunk == nullptr ? nullptr : chunk->snapshotBlocks();
+        std::shared_ptr<const BlockGrid>* old = m_grids.find(pos.x, pos.y, pos.z);
+        if (old == nullptr ? grid == nullptr : grid == *old) {
+            return;
+        }
+
+        if (!table) {
+            table = std::make_shared<WorldTable>(*m_current);
+        }
+        if (old != nullptr) {
+            m_epochs.retire(std::move(*old));
+        }
+
+        if (grid) {
+            (*table)(pos.x, pos.y, pos.z) = grid.get();
+            m_grids(pos.x, pos.y, pos.z) = std::move(grid);
+        } else {
+            table->erase(pos.x, pos.y, pos.z);
+            m_grids.erase(pos.x, pos.y, pos.z);
+        }
+    });
+
+    // Retired objects are tagged with the current epoch, which only collect() moves, so
+    // they are unlinked in the same epoch they are retired in
+    if (table) {
+        m_table.store(table.get());
+        m_epochs.retire(std::move(m_current));
+        m_current = std::move(table);
+    }
+    m_epochs.collect();
+}
+
+template <typename F>
+auto World::read(F f) const {
+    EpochDomain::Guard guard = m_epochs.pin();
+    WorldReader reader(m_table.load());
+    return f(static_cast<const WorldReader&>(reader));
+}
+
+size_t World::publishedCount() const {
+    return m_current->size();
+}
+
+size_t World::retiredCount() const {
+    return m_epochs.retiredCount();
+}
+
+size_t World::freedCount() const {
+    return m_epochs.freedCount();
+}
+
+#endif
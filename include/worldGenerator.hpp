@@ -3,13 +3,101 @@
 
 #include <string>
 #include <random>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
 #include "gamedata.hpp"
+#include "regionCache.hpp"
 #include <iostream>
 
+// Chunks per side of the regions caves and features are planned in
+#define GEN_REGION_CHUNKS 4
+// Regions kept in the cache of each stage
+#define GEN_CACHE_REGIONS 4096
+// Steps of a cave tunnel: a tunnel and its radius must stay within one region of where it
+// starts, since a chunk only reads the caves of the regions next to its own
+#define GEN_CAVE_MAX_STEPS 16
+#define GEN_CAVE_MAX_RADIUS 2.5f
+
+// Generation stages, in order. Every stage reads the outputs of the earlier ones
+enum GenStage {
+    // Terrain height of every block column
+    GEN_HEIGHT,
+    // Ground level and soil depth
+    GEN_SURFACE,
+    // Cave tunnels carved out of the terrain
+    GEN_CARVERS,
+    // Boulders placed on the surface
+    GEN_FEATURES,
+    GEN_STAGE_COUNT
+};
+
+// Region a stage computes its outputs for, and the neighbour regions a chunk reads
+struct GenStageInfo {
+    const char* name;
+    // Chunks per side of a region
+    int regionChunks;
+    // Outputs of regions up to this many regions away reach into a chunk
+    int neighbourRadius;
+};
+
+inline const GenStageInfo genStages[GEN_STAGE_COUNT] = {
+    {"height", 1, 0},
+    {"surface", 1, 0},
+    {"carvers", GEN_REGION_CHUNKS, 1},
+    {"features", GEN_REGION_CHUNKS, 1}
+};
+
+// Stage outputs. Height and surface are per chunk column, carvers per cube of
+// GEN_REGION_CHUNKS chunks and features per column of GEN_REGION_CHUNKS x GEN_REGION_CHUNKS chunks
+struct HeightMap {
+    float heights[CHUNCK_SIZE][CHUNCK_SIZE];
+};
+struct SurfaceMap {
+    // First block above the ground
+    int ground[CHUNCK_SIZE][CHUNCK_SIZE];
+    // Blocks of dirt under the ground, stone is below
+    int soilDepth[CHUNCK_SIZE][CHUNCK_SIZE];
+};
+struct CaveRegion {
+    // Spheres of air: center (xyz) and radius (w), in world block coordinates
+    std::vector<glm::vec4> spheres;
+};
+struct FeatureRegion {
+    // Spheres of stone sitting on the ground
+    std::vector<glm::vec4> boulders;
+};
+
+// Caches of every stage. Generator copies share them
+struct GenCaches {
+    RegionCache<HeightMap> heights{GEN_CACHE_REGIONS};
+    RegionCache<SurfaceMap> surfaces{GEN_CACHE_REGIONS};
+    RegionCache<CaveRegion> caves{GEN_CACHE_REGIONS};
+    RegionCache<FeatureRegion> features{GEN_CACHE_REGIONS};
+};
+
+// Deterministic random numbers for a stage and region (splitmix64)
+struct GenRandom {
+    uint64_t state;
+
+    GenRandom(int seed, int stage, int x, int y, int z);
+    uint64_t next();
+    // Returns a number between 0 and 1
+    float uniform();
+};
+
+// Generates chunks in stages. Each stage computes its outputs once per region and caches
+// them, so chunks above each other share their column's heightmap and neighbouring chunks
+// share the caves and features that cross them. Outputs are immutable and the caches are
+// thread safe: chunks can be generated in parallel
 class WorldGenerator
 {
 private:
     int m_seed;
+    int m_version;
+    std::shared_ptr<GenCaches> m_caches;
 
     // Returns a random number between 0 and 1 given a position
     float randomNumber(int x, int y);
@@ -18,6 +106,22 @@ private:
     float perlin(int x, int y, int cx, int cy, int gridSize);
     float lerp(float x, float y, float t);
 
+    // Region containing a chunk or block coordinate, for regions of size coordinates
+    static int regionOf(int v, int size);
+
+    // Stage outputs, computed on first use
+    std::shared_ptr<const HeightMap> heightMap(int x, int z);
+    std::shared_ptr<const SurfaceMap> surfaceMap(int x, int z);
+    std::shared_ptr<const CaveRegion> caveRegion(int x, int y, int z);
+    std::shared_ptr<const FeatureRegion> featureRegion(int x, int z);
+
+    // Ground level of a world block column
+    int groundAt(int x, int z);
+
+    // Applies the outputs of a stage to a chunk
+    void carveCaves(BlockGrid& chunk, int x, int y, int z, const SurfaceMap& surface);
+    void placeFeatures(BlockGrid& chunk, int x, int y, int z);
+
 public:
     WorldGenerator();
     WorldGenerator(int seed);
@@ -25,31 +129,139 @@ public:
 
     // Generates string for chunk at pos (x, y, z)
     BlockGrid genChunk(int x, int y, int z);
+
+    // Generates chunks like an older version did (see WORLD_GENERATOR_VERSION), so that new
+    // chunks of an older world match its existing ones
+    void setVersion(int version);
+    int getVersion() const;
+
+    // Prints the cache hits and misses of every stage
+    void printStats() const;
 };
 
+GenRandom::GenRandom(int seed, int stage, int x, int y, int z) {
+    state = (uint64_t)(uint32_t)seed;
+    for (int v : {stage, x, y, z}) {
+        state = (state ^ (uint32_t)v) * 0x9E3779B97F4A7C15ULL;
+        next();
+    }
+}
+
+uint64_t GenRandom::next() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+float GenRandom::uniform() {
+    return (next() >> 40) / (float)(1 << 24);
+}
+
 WorldGenerator::WorldGenerator() {
     m_seed = 0;
+    m_version = WORLD_GENERATOR_VERSION;
+    m_caches = std::make_shared<GenCaches>();
 }
 WorldGenerator::WorldGenerator(int seed) {
     m_seed = seed;
+    m_version = WORLD_GENERATOR_VERSION;
+    m_caches = std::make_shared<GenCaches>();
 }
 
-BlockGrid WorldGenerator::genChunk(int x, int y, int z) {
-    // Idea: for each (x, y) in chunk's area, we compute a perlin value t(x, y)
-    // for each block, if z > t(x, y) the block will be air, other wise it will
-    // be grass or rock. For now, we assume gridSize = chunk_size. 
+int WorldGenerator::regionOf(int v, int size) {
+    return (v >= 0) ? v / size : -((-v + size - 1) / size);
+}
 
-    // Generates perlin values
-    float perlinValues[CHUNCK_SIZE][CHUNCK_SIZE];
-    for (int i = 0; i < CHUNCK_SIZE; i++)
-    {
-        for (int j = 0; j < CHUNCK_SIZE; j++)
-        {
-            perlinValues[i][j] = 2*perlin(i, j, x, z, CHUNCK_SIZE);
+std::shared_ptr<const HeightMap> WorldGenerator::heightMap(int x, int z) {
+    return m_caches->heights.get(x, 0, z, [&]() {
+        // Idea: for each (x, z) in the column, we compute a perlin value t(x, z): blocks
+        // under it are ground. For now, we assume gridSize = chunk_size
+        HeightMap map;
+        for (int i = 0; i < CHUNCK_SIZE; i++) {
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                map.heights[i][k] = 2*perlin(i, k, x, z, CHUNCK_SIZE);
+            }
         }
-    }
+        return map;
+    });
+}
+
+std::shared_ptr<const SurfaceMap> WorldGenerator::surfaceMap(int x, int z) {
+    return m_caches->surfaces.get(x, 0, z, [&]() {
+        std::shared_ptr<const HeightMap> heights = heightMap(x, z);
+
+        SurfaceMap map;
+        for (int i = 0; i < CHUNCK_SIZE; i++) {
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                map.ground[i][k] = (int)ceil(heights->heights[i][k]);
+                map.soilDepth[i][k] = 2;
+            }
+        }
+        return map;
+    });
+}
+
+std::shared_ptr<const CaveRegion> WorldGenerator::caveRegion(int x, int y, int z) {
+    return m_caches->caves.get(x, y, z, [&]() {
+        CaveRegion region;
+        const int size = GEN_REGION_CHUNKS*CHUNCK_SIZE;
+
+        // Caves only start underground
+        if ((y + 1)*size > 0) {
+            return region;
+        }
+
+        GenRandom random(m_seed, GEN_CARVERS, x, y, z);
+        int tunnels = (int)(3*random.uniform());
+        for (int t = 0; t < tunnels; t++) {
+            glm::vec3 pos = glm::vec3(x, y, z)*(float)size + glm::vec3(random.uniform(), random.uniform(), random.uniform())*(float)size;
+            float yaw = 2*PI*random.uniform();
+            float pitch = 0.5f*(random.uniform() - 0.5f);
+            float radius = 1.2f + (GEN_CAVE_MAX_RADIUS - 1.2f)*random.uniform();
+            int steps = GEN_CAVE_MAX_STEPS/2 + (int)(GEN_CAVE_MAX_STEPS/2*random.uniform());
+
+            // Random walk, one block per step
+            for (int step = 0; step < steps; step++) {
+                region.spheres.push_back(glm::vec4(pos, radius));
+                pos += glm::vec3(cos(yaw)*cos(pitch), sin(pitch), sin(yaw)*cos(pitch));
+                yaw += 0.6f*(random.uniform() - 0.5f);
+                pitch = 0.8f*pitch + 0.3f*(random.uniform() - 0.5f);
+            }
+        }
+        return region;
+    });
+}
 
-    // Writes final chunk
+std::shared_ptr<const FeatureRegion> WorldGenerator::featureRegion(int x, int z) {
+    return m_caches->features.get(x, 0, z, [&]() {
+        FeatureRegion region;
+        const int size = GEN_REGION_CHUNKS*CHUNCK_SIZE;
+
+        GenRandom random(m_seed, GEN_FEATURES, x, 0, z);
+        int boulders = (int)(3*random.uniform());
+        for (int b = 0; b < boulders; b++) {
+            int bx = x*size + (int)(size*random.uniform());
+            int bz = z*size + (int)(size*random.uniform());
+            float radius = 1.0f + 1.5f*random.uniform();
+
+            // Depends on the surface of the column it lands on
+            region.boulders.push_back(glm::vec4(bx + 0.5f, groundAt(bx, bz), bz + 0.5f, radius));
+        }
+        return region;
+    });
+}
+
+int WorldGenerator::groundAt(int x, int z) {
+    int cx = regionOf(x, CHUNCK_SIZE);
+    int cz = regionOf(z, CHUNCK_SIZE);
+    return surfaceMap(cx, cz)->ground[x - cx*CHUNCK_SIZE][z - cz*CHUNCK_SIZE];
+}
+
+BlockGrid WorldGenerator::genChunk(int x, int y, int z) {
+    std::shared_ptr<const SurfaceMap> surface = surfaceMap(x, z);
+
+    // Base terrain: stone under the soil, dirt up to the ground, air above
     BlockGrid chunk;
     for (int i = 0; i < CHUNCK_SIZE; i++)
     {
@@ -57,12 +269,14 @@ BlockGrid WorldGenerator::genChunk(int x, int y, int z) {
         {
             for (int k = 0; k < CHUNCK_SIZE; k++)
             {
-                // Cheks if block is above or below ground
-                if (y*CHUNCK_SIZE + j < ceil(perlinValues[i][k]) - 2)
+                int height = y*CHUNCK_SIZE + j;
+                int ground = surface->ground[i][k];
+
+                if (height < ground - surface->soilDepth[i][k])
                 {
                     chunk.blocks[i][j][k] = b_blocks[1];
                 }
-                else if (y*CHUNCK_SIZE + j < ceil(perlinValues[i][k]))
+                else if (height < ground)
                 {
                     chunk.blocks[i][j][k] = b_blocks[0];
                 }
@@ -72,10 +286,103 @@ BlockGrid WorldGenerator::genChunk(int x, int y, int z) {
             }
         }
     }
-    
+
+    // Caves and boulders were added in version 2
+    if (m_version >= 2) {
+        carveCaves(chunk, x, y, z, *surface);
+        placeFeatures(chunk, x, y, z);
+    }
     return chunk;
 }
 
+void WorldGenerator::setVersion(int version) {
+    m_version = version;
+}
+
+int WorldGenerator::getVersion() const {
+    return m_version;
+}
+
+void WorldGenerator::carveCaves(BlockGrid& chunk, int x, int y, int z, const SurfaceMap& surface) {
+    const int radius = genStages[GEN_CARVERS].neighbourRadius;
+    glm::ivec3 region(regionOf(x, GEN_REGION_CHUNKS), regionOf(y, GEN_REGION_CHUNKS), regionOf(z, GEN_REGION_CHUNKS));
+    glm::vec3 low = glm::vec3(x, y, z)*(float)CHUNCK_SIZE;
+    glm::vec3 high = low + glm::vec3(CHUNCK_SIZE);
+
+    for (int rx = -radius; rx <= radius; rx++) {
+        for (int ry = -radius; ry <= radius; ry++) {
+            for (int rz = -radius; rz <= radius; rz++) {
+                std::shared_ptr<const CaveRegion> caves = caveRegion(region.x + rx, region.y + ry, region.z + rz);
+
+                for (const glm::vec4& sphere : caves->spheres) {
+                    glm::vec3 center(sphere.x, sphere.y, sphere.z);
+                    // Skips spheres that don't reach the chunk
+                    glm::vec3 closest = glm::clamp(center, low, high);
+                    if (glm::length(closest - center) > sphere.w) {
+                        continue;
+                    }
+
+                    for (int i = 0; i < CHUNCK_SIZE; i++) {
+                        for (int j = 0; j < CHUNCK_SIZE; j++) {
+                            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                                // Caves stay under the soil, so they don't pierce the surface
+                                if (y*CHUNCK_SIZE + j >= surface.ground[i][k] - surface.soilDepth[i][k]) {
+                                    continue;
+                                }
+                                if (glm::length(low + glm::vec3(i, j, k) + glm::vec3(0.5f) - center) <= sphere.w) {
+                                    chunk.blocks[i][j][k] = b_blocks[2];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void WorldGenerator::placeFeatures(BlockGrid& chunk, int x, int y, int z) {
+    const int radius = genStages[GEN_FEATURES].neighbourRadius;
+    int regionX = regionOf(x, GEN_REGION_CHUNKS);
+    int regionZ = regionOf(z, GEN_REGION_CHUNKS);
+    glm::vec3 low = glm::vec3(x, y, z)*(float)CHUNCK_SIZE;
+    glm::vec3 high = low + glm::vec3(CHUNCK_SIZE);
+
+    for (int rx = -radius; rx <= radius; rx++) {
+        for (int rz = -radius; rz <= radius; rz++) {
+            std::shared_ptr<const FeatureRegion> features = featureRegion(regionX + rx, regionZ + rz);
+
+            for (const glm::vec4& boulder : features->boulders) {
+                glm::vec3 center(boulder.x, boulder.y, boulder.z);
+                glm::vec3 closest = glm::clamp(center, low, high);
+                if (glm::length(closest - center) > boulder.w) {
+                    continue;
+                }
+
+                for (int i = 0; i < CHUNCK_SIZE; i++) {
+                    for (int j = 0; j < CHUNCK_SIZE; j++) {
+                        for (int k = 0; k < CHUNCK_SIZE; k++) {
+                            if (chunk.blocks[i][j][k].isAir && glm::length(low + glm::vec3(i, j, k) + glm::vec3(0.5f) - center) <= boulder.w) {
+                                chunk.blocks[i][j][k] = b_blocks[1];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void WorldGenerator::printStats() const {
+    size_t hits[GEN_STAGE_COUNT] = {m_caches->heights.getHits(), m_caches->surfaces.getHits(), m_caches->caves.getHits(), m_caches->features.getHits()};
+    size_t misses[GEN_STAGE_COUNT] = {m_caches->heights.getMisses(), m_caches->surfaces.getMisses(), m_caches->caves.getMisses(), m_caches->features.getMisses()};
+
+    for (int stage = 0; stage < GEN_STAGE_COUNT; stage++) {
+        std::cout << "Generation stage " << genStages[stage].name << ": " << misses[stage] << " regions computed, "
+            << hits[stage] << " reused\n";
+    }
+}
+
 float WorldGenerator::randomNumber(int x, int y) {
     std::mt19937 gen1(x);
     std::mt19937 gen2(y); 
@@ -2,12 +2,10 @@
 
 out vec4 FragColor;
 
-//in vec2 texCoord;
-in vec3 pos;
-//uniform sampler2D ourTexture;
+in vec3 texCoord;
+uniform sampler2DArray blockTextures;
 
 void main()
 {
-   //FragColor = texture(ourTexture, texCoord);
-   FragColor = vec4(0.2, pos.y, 0.2, 1.0);
+   FragColor = texture(blockTextures, texCoord);
 }
\ No newline at end of file
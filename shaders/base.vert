@@ -1,19 +1,30 @@
 #version 330 core
 
+// position relative to the chunk's corner
 layout (location = 0) in vec3 aPos;
-//layout (location = 1) in vec2 aTexCoord;
+// texture coordinates (xy) and texture array layer (z)
+layout (location = 1) in vec3 aTexCoord;
 
-//out vec2 texCoord;
-out vec3 pos;
+out vec3 texCoord;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Chunk position of every page of the mesh arena
+uniform isamplerBuffer chunkPages;
+uniform int pageVertices;
+uniform int chunkSize;
+// Chunk the camera is in: the view matrix is relative to its corner
+uniform ivec3 cameraChunk;
+
 void main()
 { 
-   gl_Position = projection*view*model*vec4(aPos, 1.0);
-   //texCoord = aTexCoord;
-   pos = aPos;
-}
+   // gl_VertexID includes the chunk's base vertex, so it tells which page the vertex is in.
+   // The offset is computed in integers, so it's exact however far the chunk is
+   ivec3 chunk = texelFetch(chunkPages, gl_VertexID / pageVertices).xyz;
+   vec3 offset = vec3((chunk - cameraChunk)*chunkSize);
 
+   gl_Position = projection*view*model*vec4(aPos + offset, 1.0);
+   texCoord = aTexCoord;
+}
\ No newline at end of file
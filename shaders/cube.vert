@@ -0,0 +1,30 @@
+#version 330 core
+
+// unit cube template, centered on the origin
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// Per instance: chunk position (xyz) and the block packed as x | y << 8 | z << 16 | ID << 24
+layout (location = 2) in ivec4 aInstance;
+
+out vec3 texCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform int chunkSize;
+// Chunk the camera is in: the view matrix is relative to its corner
+uniform ivec3 cameraChunk;
+
+void main()
+{
+   int block = aInstance.w;
+   ivec3 local = ivec3(block & 255, (block >> 8) & 255, (block >> 16) & 255);
+   int id = (block >> 24) & 255;
+
+   // Blocks span [x, x + 1] in chunk meshes, the template spans [-0.5, 0.5]
+   vec3 offset = vec3((aInstance.xyz - cameraChunk)*chunkSize + local) + vec3(0.5);
+
+   gl_Position = projection*view*model*vec4(aPos + offset, 1.0);
+   texCoord = vec3(aTexCoord, id);
+}
\ No newline at end of file
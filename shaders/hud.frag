@@ -0,0 +1,16 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 texCoord;
+in vec4 color;
+uniform sampler2D font;
+
+void main()
+{
+   float coverage = texture(font, texCoord).r;
+   if (coverage == 0.0) {
+      discard;
+   }
+   FragColor = vec4(color.rgb, color.a*coverage);
+}
\ No newline at end of file
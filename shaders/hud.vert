@@ -0,0 +1,19 @@
+#version 330 core
+
+// Position in pixels from the top left corner
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aColor;
+
+out vec2 texCoord;
+out vec4 color;
+
+uniform vec2 screenSize;
+
+void main()
+{
+   vec2 ndc = aPos/screenSize*2.0 - 1.0;
+   gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+   texCoord = aTexCoord;
+   color = aColor;
+}
\ No newline at end of file
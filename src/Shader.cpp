@@ -1,4 +1,6 @@
 #include <shaders/shaders.h>
+#include <GLFW/glfw3.h>
+#include <filesystem>
 
 // Reads a text file and outputs a string with everything in the text file
 std::string get_file_contents(const char* filename)
@@ -21,6 +23,59 @@ std::string get_file_contents(const char* filename)
     }
 }
 
+// Function pointers for program binaries (OpenGL 4.1 / ARB_get_program_binary).
+// Loaded at runtime since they are not part of the 3.3 context we request
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP ProgramBinaryGetFn)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+typedef void (APIENTRYP ProgramBinaryFn)(GLuint, GLenum, const void*, GLsizei);
+typedef void (APIENTRYP ProgramParameteriFn)(GLuint, GLenum, GLint);
+
+static ProgramBinaryGetFn pfnGetProgramBinary = nullptr;
+static ProgramBinaryFn pfnProgramBinary = nullptr;
+static ProgramParameteriFn pfnProgramParameteri = nullptr;
+
+// Returns true if the driver can save and load program binaries
+static bool programBinarySupported()
+{
+	static int supported = -1;
+	if (supported == -1)
+	{
+		pfnGetProgramBinary = (ProgramBinaryGetFn)glfwGetProcAddress("glGetProgramBinary");
+		pfnProgramBinary = (ProgramBinaryFn)glfwGetProcAddress("glProgramBinary");
+		pfnProgramParameteri = (ProgramParameteriFn)glfwGetProcAddress("glProgramParameteri");
+
+		GLint formats = 0;
+		if (pfnGetProgramBinary && pfnProgramBinary && pfnProgramParameteri)
+		{
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			// Clears the error in case the enum is not known
+			glGetError();
+		}
+		supported = formats > 0;
+	}
+	return supported;
+}
+
+// 64 bit FNV-1a hash of a string, continuing from hash
+static uint64_t hashString(const std::string& str, uint64_t hash = 14695981039346656037ULL)
+{
+	for (unsigned char c : str)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 // Constructor that build the Shader Program from 2 different shaders
 Shader::Shader(const char* vertexFile, const char* fragmentFile)
 {
@@ -28,10 +83,35 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	std::string vertexCode = get_file_contents(vertexFile);
 	std::string fragmentCode = get_file_contents(fragmentFile);
 
-	// Convert the shader source strings into character arrays
-	const char* vertexSource = vertexCode.c_str();
-	const char* fragmentSource = fragmentCode.c_str();
+	// Binaries are only valid for the same sources on the same driver
+	std::string cacheFile;
+	if (programBinarySupported())
+	{
+		uint64_t key = hashString(vertexCode);
+		key = hashString(fragmentCode, key);
+		key = hashString((const char*)glGetString(GL_VENDOR), key);
+		key = hashString((const char*)glGetString(GL_RENDERER), key);
+		key = hashString((const char*)glGetString(GL_VERSION), key);
+
+		std::stringstream name;
+		name << SHADER_CACHE_DIR << std::hex << key << ".bin";
+		cacheFile = name.str();
+	}
 
+	// Tries the cached binary first, falls back to compiling from source
+	if (cacheFile.empty() || !loadBinary(cacheFile))
+	{
+		if (compile(vertexCode.c_str(), fragmentCode.c_str()) && !cacheFile.empty())
+		{
+			saveBinary(cacheFile);
+		}
+	}
+
+	cacheUniformLocations();
+}
+
+bool Shader::compile(const char* vertexSource, const char* fragmentSource)
+{
 	// Create Vertex Shader Object and get its reference
 	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
 	// Attach Vertex Shader source to the Vertex Shader Object
@@ -64,6 +144,11 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 
 	// Create Shader Program Object and get its reference
 	ID = glCreateProgram();
+	// Asks the driver to keep the binary so it can be cached
+	if (programBinarySupported())
+	{
+		pfnProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	// Attach the Vertex and Fragment Shaders to the Shader Program
 	glAttachShader(ID, vertexShader);
 	glAttachShader(ID, fragmentShader);
@@ -82,6 +167,91 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
 
+	return success;
+}
+
+// Loads the program from a cached binary. Fails if the file is missing or the driver rejects it
+bool Shader::loadBinary(const std::string& cacheFile)
+{
+	std::ifstream in(cacheFile, std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+
+	// File layout: binary format, then the binary itself
+	GLenum format;
+	in.read(reinterpret_cast<char*>(&format), sizeof(format));
+	std::string binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (binary.empty())
+	{
+		return false;
+	}
+
+	ID = glCreateProgram();
+	pfnProgramBinary(ID, format, binary.data(), binary.size());
+
+	int success;
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		// Outdated binary (e.g. driver update): compiles from source instead
+		glDeleteProgram(ID);
+		return false;
+	}
+	return true;
+}
+
+void Shader::saveBinary(const std::string& cacheFile) const
+{
+	GLint length = 0;
+	glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::string binary(length, '\0');
+	GLenum format;
+	pfnGetProgramBinary(ID, length, NULL, &format, &binary[0]);
+
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+
+	std::ofstream out(cacheFile, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "error writing shader cache\n";
+		return;
+	}
+	out.write(reinterpret_cast<const char*>(&format), sizeof(format));
+	out.write(binary.data(), binary.size());
+}
+
+void Shader::cacheUniformLocations()
+{
+	m_uniformLocations.clear();
+
+	GLint count = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+
+	char name[256];
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+
+		std::string uniform(name, length);
+		m_uniformLocations[uniform] = glGetUniformLocation(ID, name);
+
+		// Arrays are reported as "name[0]", they can also be set as "name"
+		if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+		{
+			m_uniformLocations[uniform.substr(0, uniform.size() - 3)] = m_uniformLocations[uniform];
+		}
+	}
 }
 
 // Activates the Shader Program
@@ -96,13 +266,29 @@ void Shader::Delete()
 	glDeleteProgram(ID);
 }
 
+GLint Shader::getUniformLocation(const std::string &name) const
+{
+	auto it = m_uniformLocations.find(name);
+	if (it == m_uniformLocations.end())
+	{
+		return -1;
+	}
+	return it->second;
+}
+
 // Sets uniform variables
 void Shader::setBool(const std::string &name, bool value) const {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform1i(getUniformLocation(name), (int)value);
 }
 void Shader::setInt(const std::string &name, int value) const {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1i(getUniformLocation(name), value);
 }
 void Shader::setFloat(const std::string &name, float value) const {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1f(getUniformLocation(name), value);
+}
+void Shader::setVec3(const std::string &name, float x, float y, float z) const {
+	glUniform3f(getUniformLocation(name), x, y, z);
+}
+void Shader::setMat4(const std::string &name, const float* value) const {
+	glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, value);
 }
\ No newline at end of file
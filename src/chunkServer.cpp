@@ -0,0 +1,178 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <poll.h>
+#include <glm/glm.hpp>
+
+#include "chunk.hpp"
+#include "gamedata.hpp"
+#include "worldGenerator.hpp"
+#include "loader.hpp"
+#include "chunkProtocol.hpp"
+#include "chunkMap.hpp"
+
+// Headless chunk server: owns the world generator and the world file, and serves
+// chunks to any number of clients over a Unix socket
+
+// world generator
+WorldGenerator worldGen;
+
+int main(int argc, char** argv) {
+
+    // COMMAND LINE -------------------------------------------------------------------
+
+    // --socket PATH: where the server listens
+    std::string socketPath = CHUNK_SERVER_SOCKET;
+    // --world PATH: world file
+    std::string worldPath = WORLD_FILE;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--socket" && hasValue) {
+            socketPath = argv[++i];
+        } else if (arg == "--world" && hasValue) {
+            worldPath = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return -1;
+        }
+    }
+
+    // WORLD LOADING ------------------------------------------------------------------
+
+    std::fstream worldFile;
+    if (!wl::openWorldFile(worldFile, worldPath)) {
+        std::cerr << "Error loading world file\n";
+        return -1;
+    }
+    wl::buildChunkIndex(worldFile);
+    if (!wl::loadGeneratorVersion(worldGen, worldPath)) {
+        return -1;
+    }
+
+    // Files written by older versions can be mostly copies of old chunks
+    if (wl::isFragmented() && !wl::compactWorld(worldFile, worldPath)) {
+        return -1;
+    }
+
+    // SERVER LOOP --------------------------------------------------------------------
+
+    int listenFd = net::listenSocket(socketPath);
+    if (listenFd < 0) {
+        std::cerr << "Error: can't listen on " << socketPath << "\n";
+        return -1;
+    }
+    std::cout << "Chunk server listening on " << socketPath << "\n";
+
+    std::vector<std::unique_ptr<net::Connection>> clients;
+    std::vector<pollfd> fds;
+
+    #ifdef DEBUG
+    unsigned long long served = 0;
+    unsigned long long bytesSent = 0;
+    #endif
+
+    while (true) {
+        // Waits for new clients, requests, or room to send queued answers
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const std::unique_ptr<net::Connection>& client : clients) {
+            short events = POLLIN | (client->hasPendingOutput() ? POLLOUT : 0);
+            fds.push_back({client->getFd(), events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: poll failed\n";
+            break;
+        }
+
+        bool wroteWorld = false;
+        for (size_t i = 0; i < clients.size(); i++) {
+            net::Connection& client = *clients[i];
+            short revents = fds[i + 1].revents;
+            bool alive = true;
+
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                alive = client.receive();
+
+                // Answers every complete request, in the order they were sent
+                net::MessageHeader header;
+                std::vector<uint8_t> payload;
+                bool broken = false;
+                while (client.next(header, payload, broken)) {
+                    // Coordinates out of ChunkMap's range would alias another chunk's record.
+                    // Clients never send them, so the connection is dropped like a malformed one
+                    if (!ChunkMap<bool>::inRange(header.x, header.y, header.z)) {
+                        std::cerr << "Error: chunk coordinates out of range from a client\n";
+                        broken = true;
+                        break;
+                    }
+
+                    if (header.type == net::MSG_GET_CHUNK) {
+                        // Chunks that have never been generated are generated and added to the file
+                        BlockGrid data = wl::loadChunkData(worldGen, worldFile, header.x, header.y, header.z);
+                        wroteWorld = true;
+                        std::vector<uint8_t> compressed = net::encodeBlocks(data);
+                        client.send({net::MSG_CHUNK, header.requestId, header.x, header.y, header.z, 0}, compressed);
+
+                        #ifdef DEBUG
+                        served++;
+                        bytesSent += net::HEADER_SIZE + compressed.size();
+                        #endif
+                    } else if (header.type == net::MSG_PUT_CHUNK) {
+                        BlockGrid data;
+                        if (net::decodeBlocks(payload.data(), payload.size(), data)) {
+                            wl::writeChunk(worldFile, header.x, header.y, header.z, data);
+                            wroteWorld = true;
+                        }
+                    }
+                }
+                alive = alive && !broken;
+            }
+
+            // Sends queued answers
+            if (!client.flush()) {
+                alive = false;
+            }
+
+            if (!alive) {
+                clients.erase(clients.begin() + i);
+                fds.erase(fds.begin() + i + 1);
+                i--;
+
+                #ifdef DEBUG
+                std::cout << "Client disconnected (" << clients.size() << " connected), "
+                    << served << " chunks served, " << bytesSent/1024 << " KB sent\n";
+                #endif
+            }
+        }
+
+        // Accepts new clients
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                clients.push_back(std::make_unique<net::Connection>(fd));
+
+                #ifdef DEBUG
+                std::cout << "Client connected (" << clients.size() << " connected)\n";
+                #endif
+            }
+        }
+
+        // Makes new chunks durable if the server is killed
+        if (wroteWorld) {
+            worldFile.flush();
+        }
+    }
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+    worldFile.close();
+}
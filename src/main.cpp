@@ -8,6 +8,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <unordered_map>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <cmath>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -16,28 +21,223 @@
 #include "gamedata.hpp"
 #include "worldGenerator.hpp"
 #include "loader.hpp"
+#include "blockTicks.hpp"
+#include "textureArray.hpp"
+#include "pregen.hpp"
+#include "chunkStore.hpp"
+#include "world.hpp"
+#include "chunkWindow.hpp"
+#include "chunkScheduler.hpp"
+#include "prefetcher.hpp"
+#include "chunkCache.hpp"
+#include "chunkClient.hpp"
+#include "stagingRing.hpp"
+#include "meshArena.hpp"
+#include "cubeRenderer.hpp"
+#include "renderDistance.hpp"
+#include "gpuTimer.hpp"
+#include "perfHud.hpp"
+#include "autosave.hpp"
+#include "meshCache.hpp"
+#include "chunkLoader.hpp"
+#include "chunkRemesher.hpp"
+#include "inputRecording.hpp"
+#include "frameReport.hpp"
+#include <memory>
+#include <string>
+#include <thread>
 
 
-// Time global variables
+// Time global variables. deltaTime is the time step simulated by the frame: the recorded
+// one during a replay, the frame's real duration otherwise
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 float currentFrame = 0.0f;
 
+// Last cursor position, applied to the player once per frame
+float cursorX = 0.0f, cursorY = 0.0f;
+bool cursorMoved = false;
+
 // Player
 Player player(glm::vec3(0,0,0), glm::vec3(0,0,-1), glm::vec3(0,1,0), 20.5f, 0.1f);
 
 // world generator
 WorldGenerator worldGen;
 
-void loadTexture(const char *filename, unsigned int *texture);
+// Scheduled block updates
+BlockTicker blockTicker;
+
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void generateChunks(std::string seed, std::fstream &file, glm::ivec3 pos);
 blockType getAir();
+// Parse a command line value. Return false unless the whole text is a non-negative number
+bool parseArg(const char* text, int& value);
+bool parseArg(const char* text, size_t& value);
+bool parseArg(const char* text, double& value);
 
-int main() {
+int main(int argc, char** argv) {
     std::cout << "hello minecraft 2\n";
 
+    // COMMAND LINE -------------------------------------------------------------------
+
+    // --pregen [--radius N] [--height N] [--threads T]: generates a region of the world
+    // into the world file without opening a window
+    bool pregen = false;
+    int pregenRadius = RENDER_DISTANCE;
+    int pregenHeight = RENDER_DISTANCE;
+    int pregenThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // --compact: rewrites the world file without free space, neighbouring chunks together
+    bool compact = false;
+
+    // --chunk-budget MS: time per frame given to chunk loading and meshing
+    double chunkBudgetMs = CHUNK_LOAD_BUDGET_MS;
+    // --frame-target MS: frame time the render distance adapts to, 0 keeps it fixed
+    double frameTargetMs = FRAME_TIME_TARGET_MS;
+    bool frameTargetGiven = false;
+    // --chunk-cache MB: memory kept for chunks that left the window
+    size_t chunkCacheMb = CHUNK_CACHE_MB;
+    // --server [PATH]: gets chunks from a chunk server instead of the world file
+    bool useServer = false;
+    std::string serverSocket = CHUNK_SERVER_SOCKET;
+    // --observer X,Y,Z,R: keeps the chunks within R of chunk (X, Y, Z) loaded and ticking,
+    // like another player would. Can be given more than once
+    std::vector<glm::ivec4> observerRegions;
+    // --renderer meshed|instanced: how chunks are drawn at startup, F2 switches at runtime
+    RenderMode renderMode = RENDER_MESHED;
+    // --hud: shows the performance overlay at startup, F3 toggles it
+    bool showHud = false;
+    // --no-mesh-cache: meshes every chunk instead of reusing meshes from previous sessions
+    bool useMeshCache = true;
+    // --record FILE: writes the input of every frame to FILE
+    std::string recordPath;
+    // --replay FILE: plays back a recording instead of reading input, then prints a report
+    // of frame times, hitches and memory. The render distance stays at RENDER_DISTANCE
+    // unless --frame-target is given. --report FILE also writes the report to FILE
+    std::string replayPath;
+    std::string reportPath;
+    // --headless: hidden window, for replays. --software-gl: asks Mesa for its software
+    // renderer. A hidden window still needs a display, e.g. Xvfb on a server
+    bool headless = false;
+    bool softwareGl = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        // False if the argument's value couldn't be parsed
+        bool validValue = true;
+
+        if (arg == "--pregen") {
+            pregen = true;
+        } else if (arg == "--compact") {
+            compact = true;
+        } else if (arg == "--radius" && hasValue) {
+            validValue = parseArg(argv[++i], pregenRadius);
+        } else if (arg == "--height" && hasValue) {
+            validValue = parseArg(argv[++i], pregenHeight);
+        } else if (arg == "--threads" && hasValue) {
+            validValue = parseArg(argv[++i], pregenThreads);
+            pregenThreads = std::max(1, pregenThreads);
+        } else if (arg == "--chunk-budget" && hasValue) {
+            validValue = parseArg(argv[++i], chunkBudgetMs);
+        } else if (arg == "--frame-target" && hasValue) {
+            validValue = parseArg(argv[++i], frameTargetMs);
+            frameTargetGiven = true;
+        } else if (arg == "--chunk-cache" && hasValue) {
+            validValue = parseArg(argv[++i], chunkCacheMb);
+        } else if (arg == "--server") {
+            useServer = true;
+            if (hasValue && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                serverSocket = argv[++i];
+            }
+        } else if (arg == "--observer" && hasValue) {
+            glm::ivec4 region;
+            if (sscanf(argv[++i], "%d,%d,%d,%d", &region.x, &region.y, &region.z, &region.w) != 4 || region.w < 0) {
+                std::cerr << "Invalid observer region: " << argv[i] << "\n";
+                return -1;
+            }
+            observerRegions.push_back(region);
+        } else if (arg == "--hud") {
+            showHud = true;
+        } else if (arg == "--no-mesh-cache") {
+            useMeshCache = false;
+        } else if (arg == "--record" && hasValue) {
+            recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            replayPath = argv[++i];
+        } else if (arg == "--report" && hasValue) {
+            reportPath = argv[++i];
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--software-gl") {
+            softwareGl = true;
+        } else if (arg == "--renderer" && hasValue) {
+            std::string mode = argv[++i];
+            if (mode == "instanced") {
+                renderMode = RENDER_INSTANCED;
+            } else if (mode != "meshed") {
+                std::cerr << "Unknown renderer: " << mode << "\n";
+                return -1;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return -1;
+        }
+
+        if (!validValue) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return -1;
+        }
+    }
+
+    if (pregen || compact) {
+        std::fstream worldFile;
+        if (!wl::openWorldFile(worldFile, WORLD_FILE)) {
+            std::cerr << "Error loading world file\n";
+            return -1;
+        }
+
+        wl::buildChunkIndex(worldFile);
+        if (!wl::loadGeneratorVersion(worldGen, WORLD_FILE)) {
+            return -1;
+        }
+        if (pregen) {
+            wl::pregenerate(worldGen, worldFile, pregenRadius, pregenHeight, pregenThreads);
+        }
+        if (compact && !wl::compactWorld(worldFile, WORLD_FILE)) {
+            return -1;
+        }
+        worldFile.close();
+        return 0;
+    }
+
+    // INPUT RECORDING ---------------------------------------------------------------
+
+    if (!recordPath.empty() && !replayPath.empty()) {
+        std::cerr << "--record and --replay can't be used together\n";
+        return -1;
+    }
+    InputRecorder inputRecorder;
+    if (!recordPath.empty() && !inputRecorder.open(recordPath)) {
+        return -1;
+    }
+    InputReplay inputReplay;
+    bool replaying = !replayPath.empty();
+    if (replaying && !inputReplay.load(replayPath)) {
+        return -1;
+    }
+    // Frames hitch beyond this in the replay report
+    double reportTargetMs = frameTargetMs > 0 ? frameTargetMs : FRAME_TIME_TARGET_MS;
+    // A render distance adapting to the frame time would load more chunks in faster builds:
+    // replays keep it fixed, so that every build does the same work, unless asked otherwise
+    if (replaying && !frameTargetGiven) {
+        frameTargetMs = 0.0;
+    }
+
     // GLFW WINDOW CREATION -------------------------------------------------------------
+    if (softwareGl) {
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+    }
     glfwInit();
 
     // Tells GLFW to use OpenGL version 3
@@ -47,6 +247,9 @@ int main() {
 
     // Makes window not resizable
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    if (headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
     GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Minecraft 2", NULL, NULL);
 
     // Checks for window failures
@@ -56,6 +259,10 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // Replays measure how fast frames can be made, not the display's refresh rate
+    if (replaying) {
+        glfwSwapInterval(0);
+    }
     
     // hides cursor
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -72,15 +279,32 @@ int main() {
 
     // BUFFERS AND GEOMETRY -------------------------------------------------------------
     
-    // Vertices and indices of active chunks
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
+    // Mesh of every chunk, and the draw of each chunk of the window
+    MeshArena chunkMeshes;
+    chunkMeshes.create((size_t)MESH_ARENA_MB*1024*1024);
+    ChunkDrawList chunkDraws;
+
+    // Mesh uploads go through the staging ring, within a budget per frame
+    StagingRing stagingRing;
+    stagingRing.create((size_t)STAGING_RING_MB*1024*1024, (size_t)UPLOAD_BUDGET_KB*1024);
     
     // Generates the buffers
-    GLuint VAO, VBO, EBO;
+    GLuint VAO;
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+
+    // Indices shared by every chunk
+    QuadIndexBuffer quadIndices;
+    quadIndices.create();
+
+    // Instanced cube template, the alternative to chunk meshes
+    CubeRenderer cubeRenderer;
+    cubeRenderer.create();
+
+    // GPU time of uploads and draws, and the overlay showing it
+    GpuTimer gpuTimer;
+    gpuTimer.create();
+    PerfHud perfHud;
+    perfHud.create();
 
 
     // MOVEMENT ------------------------------------------------------------------
@@ -94,52 +318,333 @@ int main() {
     Shader baseShader("../shaders/base.vert", "../shaders/base.frag");
 
     // Finds locations of model, view and project matrix in base shader
-    unsigned int baseModelLoc = glGetUniformLocation(baseShader.ID, "model");
-	unsigned int baseViewLoc = glGetUniformLocation(baseShader.ID, "view");
-	unsigned int baseProjectionLoc = glGetUniformLocation(baseShader.ID, "projection");
+    GLint baseModelLoc = baseShader.getUniformLocation("model");
+	GLint baseViewLoc = baseShader.getUniformLocation("view");
+	GLint baseProjectionLoc = baseShader.getUniformLocation("projection");
+	GLint baseCameraChunkLoc = baseShader.getUniformLocation("cameraChunk");
+
+    // Instanced cubes use the same textures, only the vertices are placed differently
+    Shader cubeShader("../shaders/cube.vert", "../shaders/base.frag");
+    GLint cubeModelLoc = cubeShader.getUniformLocation("model");
+	GLint cubeViewLoc = cubeShader.getUniformLocation("view");
+	GLint cubeProjectionLoc = cubeShader.getUniformLocation("projection");
+	GLint cubeCameraChunkLoc = cubeShader.getUniformLocation("cameraChunk");
+
+
+    // TEXTURES LOADING ------------------------------------------------------------------
+
+    // All block textures in one texture array, indexed by block ID
+    TextureArray blockTextures;
+    blockTextures.load(t_texturesIDs, sizeof(t_texturesIDs)/sizeof(idTexture), "../textures.cache");
+
+    // The texture array is always bound to unit 0
+    baseShader.Activate();
+    baseShader.setInt("blockTextures", 0);
+
+    // The chunk page table of the mesh arena is always bound to unit 1
+    baseShader.setInt("chunkPages", 1);
+    baseShader.setInt("pageVertices", MESH_PAGE_VERTICES);
+    baseShader.setInt("chunkSize", CHUNCK_SIZE);
+
+    cubeShader.Activate();
+    cubeShader.setInt("blockTextures", 0);
+    cubeShader.setInt("chunkSize", CHUNCK_SIZE);
+
+    // The HUD font is bound to unit 2
+    Shader hudShader("../shaders/hud.vert", "../shaders/hud.frag");
+    hudShader.Activate();
+    hudShader.setInt("font", 2);
 
 
     // WORLD LOADING ------------------------------------------------------------------
    
-    Chunk* activeChunks = new Chunk[(2*RENDER_DISTANCE + 1)*(2*RENDER_DISTANCE + 1)*(2*RENDER_DISTANCE + 1)];
+    // Render distance, adapted at runtime to the frame time
+    RenderDistanceController renderDistance(RENDER_DISTANCE, frameTargetMs, MIN_RENDER_DISTANCE, MAX_RENDER_DISTANCE, RENDER_DISTANCE_MAX_BACKLOG);
 
-    // opens world file
-    std::fstream worldFile("../world.dat", std::ios::in | std::ios::out | std::ios::app);
+    // Chunks needed by any viewer, each loaded once. Other threads read the version the
+    // world publishes every frame
+    World world;
+    ChunkStore& chunkStore = world.getStore();
+    // Chunks around the player
+    ChunkWindow activeChunks(chunkStore, renderDistance.getRadius());
+    // Other viewers keeping regions of the world loaded
+    std::vector<std::unique_ptr<ChunkWindow>> observers;
+    for (glm::ivec4 region : observerRegions) {
+        observers.push_back(std::make_unique<ChunkWindow>(chunkStore, region.w));
+    }
+    // Pending chunk loads and meshes
+    ChunkScheduler chunkScheduler;
+    // Chunks loaded ahead of the player
+    ChunkPrefetcher prefetcher;
+    // Chunks that recently left the window
+    ChunkCache chunkCache(chunkCacheMb*1024*1024);
 
-    // Cheks if file exists
-    if (!worldFile) {
-        std::cerr << "Error loading world file\n";
-        return -1;
+    // Either the chunk server or the world file provides chunks
+    ChunkClient chunkClient;
+    std::fstream worldFile;
+
+    if (useServer) {
+        if (!chunkClient.connect(serverSocket)) {
+            std::cerr << "Error connecting to the chunk server at " << serverSocket << "\n";
+            return -1;
+        }
+    } else {
+        // opens world file
+        if (!wl::openWorldFile(worldFile, WORLD_FILE)) {
+            std::cerr << "Error loading world file\n";
+            return -1;
+        }
+
+        // Creates chunk index hash
+        wl::buildChunkIndex(worldFile);
+
+        // Older worlds keep the generator they were created with
+        if (!wl::loadGeneratorVersion(worldGen, WORLD_FILE)) {
+            return -1;
+        }
+
+        // Files written by older versions can be mostly copies of old chunks
+        if (wl::isFragmented() && !wl::compactWorld(worldFile, WORLD_FILE)) {
+            return -1;
+        }
     }
 
-    // Creates chunk index hash
-    wl::buildChunkIndex(worldFile);
+    // Saves modified chunks to the world file in the background
+    AutoSaver autoSaver(worldFile);
+    if (!useServer) {
+        autoSaver.start();
+    }
+
+    // Meshes from previous sessions. Chunks are meshed as usual if it can't be opened
+    MeshCache meshCache;
+    if (useMeshCache) {
+        meshCache.open(MESH_CACHE_FILE);
+    }
+    // Meshes a chunk, or reuses its mesh from the cache if its blocks haven't changed
+    auto meshChunk = [&](Chunk& chunk) {
+        if (!meshCache.isOpen() || chunk.isEmpty()) {
+            chunk.buildMesh();
+        } else if (!meshCache.load(chunk)) {
+            chunk.buildMesh();
+            meshCache.store(chunk);
+        }
+    };
+
+    // Chunks from the world file are read, generated and meshed by worker threads, which also
+    // remesh edited chunks. The main thread keeps one core, the workers use the others
+    WorkerPool workerPool;
+    MainThreadQueue mainThread;
+    workerPool.start(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+    ChunkLoader chunkLoader(worldGen, worldFile, autoSaver, meshCache, workerPool, mainThread);
+    ChunkRemesher chunkRemesher(world, workerPool, mainThread);
+    // Chunks edited this frame, remeshed once the edits are published
+    std::vector<glm::ivec3> remeshQueue;
+
+    // Chunks whose mesh has to be uploaded, in the order they were meshed
+    std::deque<glm::ivec3> uploadQueue;
+    ChunkMap<bool> uploadPending;
+    // True if the visible blocks have changed, for the instanced renderer
+    bool instancesChanged = true;
+    // Only the player's window is drawn: chunks of other viewers are uploaded when they enter it
+    auto queueUpload = [&](glm::ivec3 pos) {
+        if (!activeChunks.contains(pos)) {
+            return;
+        }
+        instancesChanged = true;
+        if (uploadPending.tryEmplace(pos.x, pos.y, pos.z).second) {
+            uploadQueue.push_back(pos);
+        }
+    };
+
+    // True if the chunks to draw have changed
+    bool drawsChanged = false;
+    // Time of the last rebuild of the cube instances
+    double lastInstanceBuild = 0.0;
 
-    // Loads first chunks
-    wl::loadActiveChunks(player, worldGen, worldFile, activeChunks);
-    // Loads vertices
-    wl::loadActiveVertices(player, vertices, indices, activeChunks);
+    #ifdef DEBUG
+    // Chunks loaded after entering the window, and chunks that were already prefetched
+    int reactiveLoads = 0;
+    int prefetchHits = 0;
+    int cacheHits = 0;
 
-    // Binds buffers
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    // Frame times and time spent rebuilding instances, per render mode
+    double modeFrameTime[2] = {0, 0};
+    int modeFrames[2] = {0, 0};
+    double instanceBuildTime = 0;
+    int instanceBuilds = 0;
+    #endif
+
+    // Puts a chunk loaded by the chunk loader where it's needed now: chunks that left the
+    // window or the prediction while loading go to the cache
+    auto placeLoadedChunk = [&](std::unique_ptr<Chunk> chunk) {
+        glm::ivec3 pos = chunk->getChunkPos();
+
+        if (chunkStore.isNeeded(pos)) {
+            if (chunkStore.at(pos) == nullptr) {
+                blockTicker.scheduleChunk(*chunk);
+                queueUpload(pos);
+                chunkStore.set(std::move(chunk));
+            }
+        } else if (prefetcher.isPredicted(pos)) {
+            prefetcher.store(std::move(chunk));
+        } else {
+            chunkCache.store(std::move(chunk));
+        }
+    };
 
-    // Sends vertecies and indicies data to the buffers
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+    // Runs a chunk load, mesh or prefetch task. Loads from the world file are started here
+    // and finish on the worker threads
+    auto runChunkTask = [&](const ChunkTask& task) {
+        Chunk* chunk = chunkStore.at(task.pos);
 
-    // Enables position attribute for shaders
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+        if (task.type == TASK_PREFETCH) {
+            // The chunk entered a window before being prefetched: it's loaded normally
+            if (chunkStore.isNeeded(task.pos)) {
+                if (chunk == nullptr) {
+                    chunkScheduler.push(task.pos, TASK_LOAD);
+                }
+                return;
+            }
+            if (!prefetcher.isPredicted(task.pos) || prefetcher.isReady(task.pos)) {
+                return;
+            }
 
-    // Unbinds
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            // Chunks that were recently in the window don't need to be loaded again
+            std::unique_ptr<Chunk> cached = chunkCache.take(task.pos);
+            if (cached) {
+                if (!cached->isMeshed()) {
+                    meshChunk(*cached);
+                }
+                prefetcher.store(std::move(cached));
+                return;
+            }
+
+            // Chunks from the server are stored when they arrive
+            if (useServer) {
+                chunkClient.request(task.pos);
+                return;
+            }
+
+            chunkLoader.request(task.pos, chunkScheduler.score(task.pos, TASK_PREFETCH), placeLoadedChunk);
+        } else if (task.type == TASK_LOAD) {
+            // Skips chunks that are already loaded, or that no viewer needs anymore
+            if (chunk != nullptr || !chunkStore.isNeeded(task.pos)) {
+                return;
+            }
+
+            #ifdef DEBUG
+                reactiveLoads++;
+            #endif
+
+            // Chunks from the server are placed in the store when they arrive
+            if (useServer) {
+                chunkClient.request(task.pos);
+                return;
+            }
+
+            // A prefetch of the chunk that is still running is placed in the store when it ends
+            chunkLoader.request(task.pos, chunkScheduler.score(task.pos, TASK_LOAD), placeLoadedChunk);
+        } else if (task.type == TASK_MESH && chunk != nullptr) {
+            meshChunk(*chunk);
+            blockTicker.scheduleChunk(*chunk);
+            queueUpload(task.pos);
+        }
+    };
+
+    // Chunks no viewer needs anymore are cached, their GPU mesh is freed. Modified chunks
+    // are saved first: the cache can drop them
+    auto evictChunk = [&](std::unique_ptr<Chunk> chunk) {
+        if (!useServer && chunk->isModified()) {
+            autoSaver.save(*chunk);
+        }
+        chunkMeshes.release(chunk->getChunkPos());
+        chunkCache.store(std::move(chunk));
+    };
+
+    // Fills chunks that entered a window with prefetched or cached chunks when possible,
+    // and queues the others. Chunks of every viewer are meshed, so that they are ready to be
+    // drawn when the player gets there
+    auto fillSlots = [&](const std::vector<glm::ivec3>& slots) {
+        for (glm::ivec3 pos : slots) {
+            std::unique_ptr<Chunk> chunk = prefetcher.take(pos);
+
+            #ifdef DEBUG
+                prefetchHits += chunk ? 1 : 0;
+            #endif
+
+            if (!chunk) {
+                chunk = chunkCache.take(pos);
+
+                #ifdef DEBUG
+                    cacheHits += chunk ? 1 : 0;
+                #endif
+            }
+            if (!chunk) {
+                chunkScheduler.push(pos, TASK_LOAD);
+                continue;
+            }
+
+            // Chunks evicted before being meshed still need their mesh
+            if (chunk->isMeshed()) {
+                blockTicker.scheduleChunk(*chunk);
+                queueUpload(pos);
+            } else {
+                chunkScheduler.push(pos, TASK_MESH);
+            }
+            chunkStore.set(std::move(chunk));
+        }
+        chunkScheduler.cancelOutside(chunkStore);
+
+        // Chunks the player's window now shares with other viewers are uploaded, the ones
+        // it doesn't draw anymore free their pages
+        for (glm::ivec3 pos : activeChunks.getSharedEntered()) {
+            if (chunkStore.at(pos)->isMeshed()) {
+                queueUpload(pos);
+            } else {
+                chunkScheduler.push(pos, TASK_MESH);
+            }
+        }
+        for (glm::ivec3 pos : activeChunks.getSharedLeft()) {
+            chunkMeshes.release(pos);
+        }
+
+        // Meshes stay in chunk space: only the list of chunks to draw changes
+        drawsChanged = true;
+        instancesChanged = true;
+    };
+
+    // Queues first chunks, they are loaded during the first frames
+    for (glm::ivec3 pos : activeChunks.recenter(player.getChunkPosition())) {
+        chunkScheduler.push(pos, TASK_LOAD);
+    }
+    for (size_t i = 0; i < observers.size(); i++) {
+        glm::ivec4 region = observerRegions[i];
+        for (glm::ivec3 pos : observers[i]->recenter(glm::ivec3(region.x, region.y, region.z))) {
+            chunkScheduler.push(pos, TASK_LOAD);
+        }
+    }
+    // Binds buffers. Done again when the mesh arena grows into a new buffer
+    GLuint meshBuffer = 0;
+    auto bindMeshBuffer = [&]() {
+        meshBuffer = chunkMeshes.getBuffer();
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+        quadIndices.bind();
+
+        // Enables position and texture attributes for shaders
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE*sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE*sizeof(float), (void*)(3*sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        // Unbinds
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    };
+    bindMeshBuffer();
 
     #ifdef DEBUG
-    std::cout << "Loaded " << vertices.size() / 3 << " triangles\n";
     std::vector<float> times;
     std::vector<float> loadingChunksTimes;
     #endif
@@ -151,93 +656,410 @@ int main() {
     glEnable(GL_DEPTH_TEST);
 
     // view and projection matrices
-    glm::mat4 view = player.getView();
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float) WIDTH / HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = player.getView(player.getChunkPosition());
+    // The far plane reaches the corners of the window, so it follows the render distance
+    auto makeProjection = [](int radius) {
+        float farPlane = sqrtf(3.0f)*(radius + 1)*CHUNCK_SIZE*SCALE_FACTOR;
+        return glm::perspective(glm::radians(45.0f), (float) WIDTH / HEIGHT, 0.1f, farPlane);
+    };
+    glm::mat4 projection = makeProjection(activeChunks.getRadius());
 
     // Stores old plyaer chunk position
     glm::ivec3 oldChunkPos = player.getChunkPosition();
 
+    // Time not yet consumed by block ticks
+    float tickAccumulator = 0.0f;
+    // Time since the last autosave
+    float autosaveTimer = 0.0f;
+
+    // Key states in the previous frame, so toggles happen once per press
+    bool rendererKeyDown = false;
+    bool hudKeyDown = false;
+    auto keyPressed = [&](int key, bool& wasDown) {
+        bool down = glfwGetKey(window, key) == GLFW_PRESS;
+        bool pressed = down && !wasDown;
+        wasDown = down;
+        return pressed;
+    };
+
+    // CPU time of the previous frame, shown by the HUD
+    double lastFrameWorkMs = 0.0;
+
+    // Simulated time, the sum of every frame's time step
+    double gameTime = 0.0;
+    // Frame measurements, reported at the end of a replay
+    FrameReport frameReport;
+    bool firstFrame = true;
+
     while (!glfwWindowShouldClose(window)) {
 
         // Computing FPS
-        currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
+        double frameStart = glfwGetTime();
+        currentFrame = frameStart;
+        // Real duration of the last frame
+        float frameSeconds = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+
+        // Input of the frame: read from the window, or from the recording during a replay
+        InputFrame input = {};
+        if (replaying) {
+            if (!inputReplay.next(input)) {
+                break;
+            }
+        } else {
+            input.deltaTime = frameSeconds;
+            input.moveKeys = Player::readMoveKeys(window);
+            if (cursorMoved) {
+                input.flags |= INPUT_LOOK;
+                input.cursorX = cursorX;
+                input.cursorY = cursorY;
+                cursorMoved = false;
+            }
+            // F2 switches renderer, F3 shows or hides the HUD
+            input.flags |= keyPressed(GLFW_KEY_F2, rendererKeyDown) ? INPUT_SWITCH_RENDERER : 0;
+            input.flags |= keyPressed(GLFW_KEY_F3, hudKeyDown) ? INPUT_TOGGLE_HUD : 0;
+        }
+        if (inputRecorder.isOpen()) {
+            inputRecorder.record(input);
+        }
+        deltaTime = input.deltaTime;
+        gameTime += deltaTime;
+
+        // Movement
+        if (input.flags & INPUT_LOOK) {
+            player.look(input.cursorX, input.cursorY);
+        }
+        player.move(input.moveKeys, deltaTime);
+
+        if (input.flags & INPUT_SWITCH_RENDERER) {
+            renderMode = renderMode == RENDER_MESHED ? RENDER_INSTANCED : RENDER_MESHED;
+            instancesChanged = true;
+
+            #ifdef DEBUG
+                std::cout << "Renderer: " << (renderMode == RENDER_MESHED ? "meshed" : "instanced") << "\n";
+            #endif
+        }
+        if (input.flags & INPUT_TOGGLE_HUD) {
+            showHud = !showHud;
+        }
+        prefetcher.record(gameTime, player.getPosition());
         
-        // Input and movement
-        player.processCameraMovement(window, deltaTime);
-        
-        // chunk loading: only loads if chunk position changed
+        // Block ticks: run at a fixed rate, modified chunks are remeshed and reuploaded. They
+        // are sent to the server right away, or saved by the next autosave
+        tickAccumulator += deltaTime;
+        int ticksRun = 0;
+        while (tickAccumulator >= 1.0f/TICKS_PER_SECOND && ticksRun < MAX_TICKS_PER_FRAME)
+        {
+            tickAccumulator -= 1.0f/TICKS_PER_SECOND;
+            ticksRun++;
+
+            std::vector<Chunk*> modified = blockTicker.tick(chunkStore);
+            for (Chunk* chunk : modified) {
+                if (useServer) {
+                    chunkClient.put(*chunk);
+                }
+                chunkStore.markChanged(chunk->getChunkPos());
+                remeshQueue.push_back(chunk->getChunkPos());
+                instancesChanged = true;
+            }
+        }
+        // Drops the ticks that couldn't keep up instead of accumulating them
+        if (ticksRun == MAX_TICKS_PER_FRAME) {
+            tickAccumulator = 0.0f;
+        }
+
+        // Autosave: only takes snapshots of the modified chunks, the saver thread writes them
+        autosaveTimer += deltaTime;
+        if (autosaveTimer >= AUTOSAVE_SECONDS && !useServer) {
+            autosaveTimer = 0.0f;
+            chunkStore.forEachLoaded([&](Chunk& chunk) {
+                if (chunk.isModified()) {
+                    autoSaver.save(chunk);
+                }
+            });
+        }
+
+        // chunk loading: only moves the window if chunk position changed. Chunks still in
+        // the window are kept, the new ones are queued
         if (oldChunkPos != player.getChunkPosition())
         {
             #ifdef DEBUG
                 std::cout << "Player chunk position: " << player.getChunkPosition().x << " " << player.getChunkPosition().y << " " << player.getChunkPosition().z << "\n";
-                std::cout << "Loading chunks \n";
+            #endif
+
+            fillSlots(activeChunks.recenter(player.getChunkPosition(), evictChunk));
+        }
+        oldChunkPos = player.getChunkPosition();
+
+        // Queues the chunks that will enter the window in the next PREFETCH_SECONDS, and drops
+        // speculative work the player moved away from
+        unsigned int predictionGeneration = prefetcher.getGeneration();
+        for (glm::ivec3 pos : prefetcher.predict(activeChunks, PREFETCH_SECONDS)) {
+            chunkScheduler.push(pos, TASK_PREFETCH);
+        }
+        if (prefetcher.getGeneration() != predictionGeneration) {
+            chunkScheduler.cancelIf([&](const ChunkTask& task) {
+                return task.type == TASK_PREFETCH && !chunkStore.isNeeded(task.pos) && !prefetcher.isPredicted(task.pos);
+            });
+        }
+
+        // Chunks received from the server go where they are needed, and are meshed as tasks
+        for (ReceivedChunk& received : chunkClient.poll()) {
+            std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>(received.pos, received.data, false);
+
+            if (chunkStore.isNeeded(received.pos)) {
+                if (chunkStore.at(received.pos) == nullptr) {
+                    chunkStore.set(std::move(chunk));
+                    chunkScheduler.push(received.pos, TASK_MESH);
+                }
+            } else if (prefetcher.isPredicted(received.pos)) {
+                prefetcher.store(std::move(chunk));
+            } else {
+                chunkCache.store(std::move(chunk));
+            }
+        }
+
+        // Loads and meshes pending chunks, closest and most visible first, within the frame's budget
+        chunkScheduler.prioritize(player.getChunkPosition(), player.getFront());
+        double loadStart = glfwGetTime();
+        if (!chunkScheduler.empty())
+        {
+            #ifdef DEBUG
                 float loadChunkTime = glfwGetTime();
             #endif
 
-            // reloads chunks
-            wl::loadActiveChunks(player, worldGen, worldFile, activeChunks);
-            // reloads vertices
-            wl::loadActiveVertices(player, vertices, indices, activeChunks);
+            chunkScheduler.drain(chunkBudgetMs, runChunkTask);
 
             #ifdef DEBUG
                 loadingChunksTimes.push_back(glfwGetTime() - loadChunkTime);
             #endif
+        }
 
-            // Updates vertex data:
-            glBindVertexArray(VAO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        // Loads running on the workers: the ones for chunks that left every window and the
+        // prediction are cancelled, the others are reordered for where the player is now,
+        // prefetches after the chunks a window is waiting for.
+        // Loads back from the workers are finished within the frame's budget
+        if (chunkLoader.inFlightCount() > 0 || chunkRemesher.inFlightCount() > 0)
+        {
+            chunkLoader.cancelIf([&](glm::ivec3 pos) {
+                return !chunkStore.isNeeded(pos) && !prefetcher.isPredicted(pos);
+            });
+            workerPool.reprioritize([&](glm::ivec3 pos) {
+                return chunkScheduler.score(pos, chunkStore.isNeeded(pos) ? TASK_LOAD : TASK_PREFETCH);
+            });
+            mainThread.drain(chunkBudgetMs);
+        }
+        double loadMs = 1000*(glfwGetTime() - loadStart);
+
+        // Makes this frame's loads, edits and evictions visible to reader threads
+        world.publish();
 
-            // Sends vertecies and indicies data to the buffers
-            glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), indices.data(), GL_STATIC_DRAW);
+        // Edited chunks are remeshed by the workers from the version just published, and
+        // uploaded when their mesh is back
+        for (glm::ivec3 pos : remeshQueue) {
+            chunkRemesher.remesh(pos, chunkScheduler.score(pos, TASK_LOAD), [&](const Chunk& meshed) {
+                Chunk* chunk = chunkStore.at(meshed.getChunkPos());
+                if (chunk != nullptr) {
+                    const std::vector<float>& vertices = meshed.getChunkVertices();
+                    chunk->setMesh(vertices.data(), vertices.size(), meshed.hasGravityBlocks());
+                    queueUpload(meshed.getChunkPos());
+                }
+            });
+        }
+        remeshQueue.clear();
+
+        // Uploads changed meshes until the frame's upload budget is used up. Only the
+        // changed chunks are uploaded, the rest of the arena is left untouched
+        gpuTimer.begin(GPU_PHASE_UPLOAD);
+        while (!uploadQueue.empty())
+        {
+            glm::ivec3 pos = uploadQueue.front();
+            Chunk* chunk = chunkStore.at(pos);
 
-            // Enables position attribute for shaders
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-            glEnableVertexAttribArray(0);
+            // Chunks that left the player's window are not uploaded
+            if (chunk != nullptr && activeChunks.contains(pos) && !chunkMeshes.upload(*chunk, stagingRing)) {
+                break;
+            }
 
-            // Unbinds
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-            glBindVertexArray(0);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            uploadQueue.pop_front();
+            uploadPending.erase(pos.x, pos.y, pos.z);
+            drawsChanged = true;
+        }
+        gpuTimer.end();
+
+        // The VAO still points to the old buffer after the arena grew
+        if (chunkMeshes.getBuffer() != meshBuffer)
+        {
+            bindMeshBuffer();
+        }
+
+        if (drawsChanged)
+        {
+            chunkMeshes.buildDrawList(activeChunks, chunkDraws);
+            drawsChanged = false;
+        }
+
+        // Instances are only kept up to date while they are drawn. They cover the whole
+        // window, so while chunks are loading they are rebuilt once per batch of chunks
+        // rather than every frame
+        bool chunksLoading = !chunkScheduler.empty() || chunkLoader.inFlightCount() > 0 || chunkClient.inFlightCount() > 0
+            || !uploadQueue.empty();
+        bool instanceBatchDue = !chunksLoading || 1000*(frameStart - lastInstanceBuild) >= WINDOW_REBUILD_INTERVAL_MS;
+        if (renderMode == RENDER_INSTANCED && instancesChanged && instanceBatchDue)
+        {
+            #ifdef DEBUG
+                float buildTime = glfwGetTime();
+            #endif
+
+            cubeRenderer.build(activeChunks);
+            instancesChanged = false;
+            lastInstanceBuild = frameStart;
+
+            #ifdef DEBUG
+                instanceBuildTime += glfwGetTime() - buildTime;
+                instanceBuilds++;
+            #endif
         }
-        oldChunkPos = player.getChunkPosition();
         
+        gpuTimer.begin(GPU_PHASE_DRAW);
+
         // color and buffer refresh
         glClearColor(0.1f, 0.5f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Activates shader (for now all blocks have the same one)
-        baseShader.Activate();
+        // One bind for all block textures
+        blockTextures.bind(0);
 
-        // Sets view matrix
-        view = player.getView();
+        // Sets view matrix, relative to the camera's chunk: chunk offsets are added by the shader
+        glm::ivec3 cameraChunk = player.getChunkPosition();
+        view = player.getView(cameraChunk);
         
-        // Sets active chunks position
+        // Scales the world
         glm::mat4 model(1.0f);
         model = glm::scale(model, glm::vec3(SCALE_FACTOR));
-        model = glm::translate(model, glm::vec3((CHUNCK_SIZE)*activeChunks[IDX(RENDER_DISTANCE, RENDER_DISTANCE, RENDER_DISTANCE)].getChunkPos()));
 
-        // Assigns matrices values to shaders
-        glUniformMatrix4fv(baseModelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(baseViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(baseProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        if (renderMode == RENDER_MESHED) {
+            baseShader.Activate();
+            chunkMeshes.bindPageTable(1);
 
-        // Draws
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            // Assigns matrices values to shaders
+            glUniformMatrix4fv(baseModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix4fv(baseViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(baseProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+            glUniform3i(baseCameraChunkLoc, cameraChunk.x, cameraChunk.y, cameraChunk.z);
+
+            // Draws
+            glBindVertexArray(VAO);
+            chunkDraws.draw();
+        } else {
+            cubeShader.Activate();
+
+            glUniformMatrix4fv(cubeModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix4fv(cubeViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(cubeProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+            glUniform3i(cubeCameraChunkLoc, cameraChunk.x, cameraChunk.y, cameraChunk.z);
+
+            cubeRenderer.draw();
+        }
+        gpuTimer.end();
+
+        perfHud.record(1000*frameSeconds);
+        if (showHud)
+        {
+            PerfStats stats;
+            stats.frameMs = 1000*frameSeconds;
+            stats.cpuMs = lastFrameWorkMs;
+            stats.hasGpuTimes = gpuTimer.hasResults();
+            stats.gpuUploadMs = gpuTimer.getPhaseMs(GPU_PHASE_UPLOAD);
+            stats.gpuDrawMs = gpuTimer.getPhaseMs(GPU_PHASE_DRAW);
+            stats.targetMs = renderDistance.isEnabled() ? frameTargetMs : 0.0;
+
+            stats.triangles = renderMode == RENDER_MESHED ? chunkDraws.triangleCount() : cubeRenderer.triangleCount();
+            stats.renderDistance = activeChunks.getRadius();
+            stats.chunksLoaded = chunkStore.loadedCount();
+            stats.chunksPending = chunkScheduler.size() + chunkLoader.inFlightCount() + chunkClient.inFlightCount();
+            stats.uploadsPending = uploadQueue.size();
+            stats.uploadBytes = stagingRing.getFrameUploaded();
+
+            stats.meshBytes = chunkMeshes.getUsedBytes();
+            stats.chunkBytes = 0;
+            chunkStore.forEachLoaded([&](const Chunk& chunk) {
+                stats.chunkBytes += chunk.getMemoryUsage();
+            });
+            stats.cacheBytes = chunkCache.getMemoryUsage();
+
+            perfHud.draw(stats, hudShader, 2);
+        }
+
+        // Staging memory used this frame is reused once the GPU is done with it
+        stagingRing.endFrame();
+        // Reads the GPU times of previous frames that are ready
+        gpuTimer.endFrame();
+
+        // Time spent on the frame, without waiting for the swap: vsync isn't a slow frame
+        double frameWorkMs = 1000*(glfwGetTime() - frameStart);
+        lastFrameWorkMs = frameWorkMs;
 
         // Buffers swap and events -------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
 
+        // The first frame only measures startup
+        if (replaying && !firstFrame)
+        {
+            frameReport.addFrame(1000*(glfwGetTime() - frameStart), frameWorkMs, loadMs);
+
+            size_t chunkBytes = 0;
+            chunkStore.forEachLoaded([&](const Chunk& chunk) {
+                chunkBytes += chunk.getMemoryUsage();
+            });
+            frameReport.sampleMemory(chunkStore.loadedCount(), chunkBytes, chunkMeshes.getUsedBytes(), chunkCache.getMemoryUsage());
+        }
+        firstFrame = false;
+
+        // Grows or shrinks the window around the same center, keeping the chunks still inside
+        // GPU bound frames are judged by their GPU time
+        double frameCostMs = std::max(frameWorkMs, gpuTimer.getFrameMs());
+        int radius = renderDistance.update(frameSeconds, frameCostMs, chunkScheduler.size() + chunkLoader.inFlightCount() + uploadQueue.size());
+        if (radius != activeChunks.getRadius())
+        {
+            #ifdef DEBUG
+                std::cout << "Render distance: " << radius << " (" << renderDistance.getAverageMs() << " ms per frame)\n";
+            #endif
+
+            fillSlots(activeChunks.resize(radius, evictChunk));
+            projection = makeProjection(radius);
+        }
+
         #ifdef DEBUG
-        times.push_back(deltaTime);
+        times.push_back(frameSeconds);
+        modeFrameTime[renderMode] += frameSeconds;
+        modeFrames[renderMode]++;
         #endif
     }
 
+    // Stops the loads still running: workers use the world file, which is closed below
+    chunkLoader.cancelAll();
+    workerPool.reprioritize([](glm::ivec3) {
+        return 0.0f;
+    });
+    while (chunkLoader.inFlightCount() > 0 || chunkRemesher.inFlightCount() > 0) {
+        if (mainThread.drain(1000.0) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    workerPool.stop();
+
+    inputRecorder.close();
+    if (replaying)
+    {
+        frameReport.print(std::cout, reportTargetMs);
+        if (!reportPath.empty()) {
+            std::ofstream reportFile(reportPath);
+            frameReport.print(reportFile, reportTargetMs);
+        }
+    }
+
     #ifdef DEBUG
     float sum = 0;
     for (int i = 0; i < times.size(); i++)
@@ -252,56 +1074,122 @@ int main() {
         sum2 += loadingChunksTimes[i];
     }
     std::cout << "DEBUG: Average chunk loading time: " << sum2/loadingChunksTimes.size() << std::endl;
+    std::cout << "DEBUG: Chunk meshes: " << chunkMeshes.getUsedBytes()/1024 << " KB, "
+        << chunkDraws.triangleCount() << " triangles drawn" << std::endl;
+    std::cout << "DEBUG: Synchronous chunk loads: " << reactiveLoads << ", prefetched chunks used: " << prefetchHits
+        << ", cached chunks used: " << cacheHits << " (" << chunkCache.size() << " cached, "
+        << chunkCache.getMemoryUsage()/(1024*1024) << " MB)" << std::endl;
+
+    // Chunks shared by overlapping viewers are only loaded once
+    size_t viewerChunks = activeChunks.getSide()*activeChunks.getSide()*activeChunks.getSide();
+    for (const std::unique_ptr<ChunkWindow>& observer : observers) {
+        viewerChunks += observer->getSide()*observer->getSide()*observer->getSide();
+    }
+    std::cout << "DEBUG: Chunk store: " << chunkStore.neededCount() << " chunks needed by " << 1 + observers.size()
+        << " viewers, " << viewerChunks << " without sharing" << std::endl;
+    std::cout << "DEBUG: World: " << world.publishedCount() << " chunks published, " << world.freedCount()
+        << " versions freed, " << world.retiredCount() << " waiting for readers" << std::endl;
+    std::cout << "DEBUG: Chunk loader: " << chunkLoader.getCompleted() << " loads completed, "
+        << chunkLoader.getCancelled() << " cancelled" << std::endl;
+    std::cout << "DEBUG: Chunk remesher: " << chunkRemesher.getCompleted() << " remeshes completed, "
+        << chunkRemesher.getDiscarded() << " discarded" << std::endl;
+    if (meshCache.isOpen()) {
+        std::cout << "DEBUG: Mesh cache: " << meshCache.getHits() << " meshes reused, " << meshCache.getMisses()
+            << " built, " << meshCache.getStored() << " stored (" << meshCache.size() << " in the cache)" << std::endl;
+    }
+
+    // Compares the two renderers on the frames each one drew
+    const char* modeNames[2] = {"meshed", "instanced"};
+    for (int mode = 0; mode < 2; mode++) {
+        if (modeFrames[mode] > 0) {
+            std::cout << "DEBUG: Renderer " << modeNames[mode] << ": " << modeFrames[mode] << " frames, "
+                << 1000*modeFrameTime[mode]/modeFrames[mode] << " ms per frame" << std::endl;
+        }
+    }
+    if (instanceBuilds > 0) {
+        std::cout << "DEBUG: Instance rebuilds: " << instanceBuilds << ", " << 1000*instanceBuildTime/instanceBuilds
+            << " ms on average, " << cubeRenderer.getInstanceCount() << " cubes (" << cubeRenderer.triangleCount()
+            << " triangles)" << std::endl;
+    }
     #endif
 
     // Terminates the program
-    worldFile.close();
+    if (useServer) {
+        // Sends the last modified chunks
+        chunkClient.poll();
+    } else {
+        // Saves the chunks modified since the last autosave and waits for the writes
+        chunkStore.forEachLoaded([&](Chunk& chunk) {
+            if (chunk.isModified()) {
+                autoSaver.save(chunk);
+            }
+        });
+        autoSaver.stop();
+
+        #ifdef DEBUG
+            std::cout << "DEBUG: Autosaved " << autoSaver.getSavedCount() << " chunks" << std::endl;
+        #endif
+
+        worldFile.close();
+    }
+
+    meshCache.close();
 
     glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
+	chunkMeshes.Delete();
+	stagingRing.Delete();
+	quadIndices.Delete();
+	cubeRenderer.Delete();
+	gpuTimer.Delete();
+	perfHud.Delete();
 	baseShader.Delete();
-    delete[] activeChunks;
+	cubeShader.Delete();
+	hudShader.Delete();
+    blockTextures.Delete();
 
     glfwDestroyWindow(window);
     glfwTerminate();
 }
 
-// Loads an OpenGL texture from a file
-void loadTexture(const char *filename, unsigned int *texture) {
-    // Creates and binds the OpenGL object
-    glGenTextures(1, texture);
-    glBindTexture(GL_TEXTURE_2D, *texture);
-
-	// sets filtering options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Loads the image
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
-    
-    // Generates the OpenGL texture
-	if(data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else {
-		std::cout << "Failed to load the texture" << std::endl;
-	}
-
-    // Removes the image texture from memory
-	stbi_image_free(data);
-
-    // Unbinds the texture
-    glBindTexture(GL_TEXTURE_2D, 0);
+// mouse callback for camera movement
+void mouse_callback(GLFWwindow*, double xpos, double ypos) {
+    cursorX = xpos;
+    cursorY = ypos;
+    cursorMoved = true;
 }
 
-// mouse callback for camera movement
-void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
-    player.cameraMouseCallback(window, xpos, ypos);
+bool parseArg(const char* text, int& value) {
+    char* end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < 0 || parsed > INT_MAX) {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+bool parseArg(const char* text, size_t& value) {
+    // strtoull accepts a minus sign and wraps the value around
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || strchr(text, '-') != nullptr) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool parseArg(const char* text, double& value) {
+    char* end;
+    errno = 0;
+    double parsed = strtod(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(parsed) || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
 }
 
 blockType getAir() {
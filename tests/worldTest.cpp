@@ -0,0 +1,219 @@
+// Publishes, reads and reclaims World versions from several threads at once. Run it under
+// -fsanitize=address or thread too: a grid freed while a reader holds it shows up there
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "chunk.hpp"
+#include "worldGenerator.hpp"
+#include "world.hpp"
+#include "async.hpp"
+#include "workerPool.hpp"
+#include "chunkRemesher.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+// Grid whose blocks all have the same ID, so that a reader can tell a torn grid
+static BlockGrid uniformGrid(unsigned int id) {
+    BlockGrid grid{};
+    for (auto& plane : grid.blocks) {
+        for (auto& row : plane) {
+            for (blockType& block : row) {
+                block.ID = id;
+                block.isAir = false;
+                block.hasGravity = false;
+            }
+        }
+    }
+    return grid;
+}
+
+// Sets every block of a chunk to id, as one edit of the main thread
+static void fillChunk(Chunk& chunk, unsigned int id) {
+    blockType block{id, false, false};
+    for (int i = 0; i < CHUNCK_SIZE; i++) {
+        for (int j = 0; j < CHUNCK_SIZE; j++) {
+            for (int k = 0; k < CHUNCK_SIZE; k++) {
+                chunk.setBlock(block, i, j, k);
+            }
+        }
+    }
+}
+
+// An object retired while a reader is pinned is only freed after the reader leaves
+static void testEpochs() {
+    EpochDomain epochs;
+    std::shared_ptr<int> object = std::make_shared<int>(1);
+    std::weak_ptr<int> watch = object;
+
+    {
+        EpochDomain::Guard guard = epochs.pin();
+        epochs.retire(std::move(object));
+        for (int i = 0; i < 10; i++) {
+            epochs.collect();
+        }
+        check(!watch.expired(), "retired object freed while a reader is pinned");
+    }
+
+    for (int i = 0; i < 3; i++) {
+        epochs.collect();
+    }
+    check(watch.expired(), "retired object not freed once readers left");
+    check(epochs.retiredCount() == 0 && epochs.freedCount() == 1, "retired and freed counts");
+}
+
+// Readers check every grid they see while the main thread loads, edits, releases and publishes
+static void testPublishReadReclaim() {
+    const int chunkCount = 64;
+    const int rounds = 5000;
+
+    World world;
+    ChunkStore& store = world.getStore();
+    std::atomic<bool> stop(false);
+    std::atomic<long> reads(0);
+    std::atomic<long> torn(0);
+    std::atomic<long> older(0);
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            // Versions only move forward: a reader never sees an edit undone
+            std::vector<unsigned int> seen(chunkCount, 0);
+
+            while (!stop.load()) {
+                world.read([&](const WorldReader& reader) {
+                    for (int i = 0; i < chunkCount; i++) {
+                        const BlockGrid* blocks = reader.chunkBlocks(glm::ivec3(i, 0, 0));
+                        if (blocks == nullptr) {
+                            continue;
+                        }
+
+                        unsigned int id = blocks->blocks[0][0][0].ID;
+                        for (auto& plane : blocks->blocks) {
+                            for (auto& row : plane) {
+                                for (const blockType& block : row) {
+                                    torn += block.ID != id;
+                                }
+                            }
+                        }
+                        older += id < seen[i];
+                        seen[i] = id;
+                    }
+                });
+                reads++;
+            }
+        });
+    }
+
+    // Chunk i holds the round of its last edit
+    for (int round = 1; round <= rounds; round++) {
+        glm::ivec3 pos(round % chunkCount, 0, 0);
+
+        if (store.at(pos) == nullptr) {
+            store.acquire(pos);
+            store.set(std::make_unique<Chunk>(pos, uniformGrid(round), false));
+        } else if (round % 7 == 0) {
+            store.release(pos, [](std::unique_ptr<Chunk>) {});
+        } else {
+            fillChunk(*store.at(pos), round);
+            store.markChanged(pos);
+        }
+        world.publish();
+    }
+
+    stop.store(true);
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    // Without readers, every retired version is freed after a couple of publishes
+    for (int i = 0; i < 3; i++) {
+        world.publish();
+    }
+
+    std::cout << "world: " << reads.load() << " reads, " << world.freedCount() << " versions freed\n";
+    check(reads.load() > 0, "readers ran");
+    check(torn.load() == 0, "a reader saw a grid being edited");
+    check(older.load() == 0, "a reader saw an older version after a newer one");
+    check(world.retiredCount() == 0, "retired versions freed once readers are gone");
+    check(world.freedCount() > 0, "versions were reclaimed");
+}
+
+// Remeshes from worker threads read the published world while the main thread edits it
+static void testRemesher() {
+    const int chunkCount = 16;
+
+    World world;
+    ChunkStore& store = world.getStore();
+    WorkerPool pool;
+    pool.start(4);
+    MainThreadQueue mainThread;
+    ChunkRemesher remesher(world, pool, mainThread);
+
+    for (int i = 0; i < chunkCount; i++) {
+        glm::ivec3 pos(i, 0, 0);
+        store.acquire(pos);
+        store.set(std::make_unique<Chunk>(pos, uniformGrid(1), false));
+    }
+    world.publish();
+
+    int applied = 0;
+    for (int round = 2; round < 200; round++) {
+        glm::ivec3 pos(round % chunkCount, 0, 0);
+        Chunk* chunk = store.at(pos);
+
+        // Every other round only a corner changes, so meshes differ between rounds
+        blockType block{(unsigned int)round, round % 2 == 0, false};
+        chunk->setBlock(block, 0, 0, 0);
+        store.markChanged(pos);
+        world.publish();
+
+        remesher.remesh(pos, 0.0f, [&](const Chunk& meshed) {
+            Chunk* target = store.at(meshed.getChunkPos());
+            const std::vector<float>& vertices = meshed.getChunkVertices();
+            target->setMesh(vertices.data(), vertices.size(), meshed.hasGravityBlocks());
+            applied++;
+        });
+        mainThread.drain(1.0);
+    }
+
+    while (remesher.inFlightCount() > 0) {
+        if (mainThread.drain(1000.0) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    pool.stop();
+
+    // The last remesh of each chunk is never discarded, so every mesh matches its blocks
+    bool upToDate = true;
+    store.forEachLoaded([&](Chunk& chunk) {
+        std::vector<float> remeshed = chunk.getChunkVertices();
+        chunk.buildMesh();
+        upToDate = upToDate && remeshed == chunk.getChunkVertices();
+    });
+
+    std::cout << "remesher: " << applied << " applied, " << remesher.getDiscarded() << " discarded\n";
+    check(applied > 0, "remeshes were applied");
+    check(upToDate, "meshes match the last edit");
+}
+
+int main() {
+    testEpochs();
+    testPublishReadReclaim();
+    testRemesher();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "all checks passed\n";
+    return 0;
+}